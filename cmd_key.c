@@ -100,20 +100,46 @@ int cmd_key(context_t *context) {
     window_arg = "%1";
   }
 
-  int (*keyfunc)(const xdo_t *, Window, const char *, useconds_t) = NULL;
+  int (*keyfunc)(const xdo_keysequence_t *, Window, useconds_t) = NULL;
 
   if (!strcmp(cmd, "key")) {
-    keyfunc = xdo_send_keysequence_window;
+    keyfunc = xdo_keysequence_send;
   } else if (!strcmp(cmd, "keyup")) {
-    keyfunc = xdo_send_keysequence_window_up;
+    keyfunc = xdo_keysequence_send_up;
   } else if (!strcmp(cmd, "keydown")) {
-    keyfunc = xdo_send_keysequence_window_down;
+    keyfunc = xdo_keysequence_send_down;
   } else {
     fprintf(stderr, "Unknown command '%s'\n", cmd);
     return 1;
   }
 
+  /* Parse each keysequence once, rather than once per window and per
+   * repetition. */
   int max_arg = context->argc;
+  xdo_keysequence_t **seqs = calloc(context->argc, sizeof(xdo_keysequence_t *));
+  for (i = 0; i < context->argc; i++) {
+    if (is_command(context->argv[i])) {
+      max_arg = i;
+      break;
+    }
+
+    seqs[i] = xdo_keysequence_new(context->xdo, context->argv[i]);
+    if (seqs[i] == NULL) {
+      fprintf(stderr,
+              "xdo_keysequence_new reported an error for string '%s'\n",
+              context->argv[i]);
+    }
+  }
+
+  /* Saves asking who has focus for every keysequence. */
+  if (window_arg != NULL) {
+    xdo_enable_focus_tracking(context->xdo);
+  }
+
+  /* Bind spare keycodes and read the keyboard group once for every
+   * repetition, rather than on each. */
+  xdo_keysequence_begin(context->xdo);
+
   window_each(context, window_arg, {
     if (clear_modifiers) {
       xdo_get_active_modifiers(context->xdo, &active_mods, &active_mods_n);
@@ -121,18 +147,14 @@ int cmd_key(context_t *context) {
     }
 
     for (j = 0; j < repeat; j++) {
-      for (i = 0; i < context->argc; i++) {
-        if (is_command(context->argv[i])) {
-          max_arg = i;
-          break;
+      for (i = 0; i < max_arg; i++) {
+        /* Couldn't be parsed, and was reported above. */
+        if (seqs[i] == NULL) {
+          ret++;
+          continue;
         }
-        int tmp = keyfunc(context->xdo, window, context->argv[i], key_delay);
-        if (tmp != 0) {
-          fprintf(stderr,
-                  "xdo_send_keysequence_window reported an error for string '%s'\n",
-                  context->argv[i]);
-        }
-        ret += tmp;
+
+        ret += keyfunc(seqs[i], window, key_delay);
       } /* each keysequence */
 
       /* Sleep if --repeat-delay given and not on the last repetition */
@@ -147,6 +169,17 @@ int cmd_key(context_t *context) {
     }
   }); /* window_each(...) */
 
+  xdo_keysequence_end(context->xdo);
+
+  if (window_arg != NULL) {
+    xdo_disable_focus_tracking(context->xdo);
+  }
+
+  for (i = 0; i < max_arg; i++) {
+    xdo_keysequence_free(seqs[i]);
+  }
+  free(seqs);
+
   if (free_arg) {
     free((char *)window_arg);
   }
@@ -213,9 +213,19 @@ static int _mousemove(context_t *context, struct mousemove *mousemove) {
   if (ret) {
     fprintf(stderr, "xdo_move_mouse reported an error\n");
   } else {
-    if (mousemove->opsync) {
+    /* x,y are screen coordinates unless they are relative to a window. If
+     * the mouse is already there it won't move, so there is nothing to
+     * wait for. */
+    int already_there = (window == CURRENTWINDOW
+                         || mousemove->polar_coordinates)
+                        && mx == x && my == y && mscreen == screen;
+    if (mousemove->opsync && !already_there) {
       /* Wait until the mouse moves away from its current position */
-      xdo_wait_for_mouse_move_from(context->xdo, mx, my);
+      ret = xdo_wait_for_mouse_move_from(context->xdo, mx, my);
+      if (ret) {
+        fprintf(stderr, "mousemove: the mouse did not move from %d,%d in "
+                "time\n", mx, my);
+      }
     }
   }
 
@@ -224,5 +234,5 @@ static int _mousemove(context_t *context, struct mousemove *mousemove) {
     free(active_mods);
   }
 
-  return 0;
+  return ret;
 } /* int mousemove ... */
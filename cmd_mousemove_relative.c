@@ -111,7 +111,11 @@ int cmd_mousemove_relative(context_t *context) {
   } else {
     if (opsync) {
       /* Wait until the mouse moves away from its current position */
-      xdo_wait_for_mouse_move_from(context->xdo, origin_x, origin_y);
+      ret = xdo_wait_for_mouse_move_from(context->xdo, origin_x, origin_y);
+      if (ret) {
+        fprintf(stderr, "mousemove_relative: the mouse did not move from "
+                "%d,%d in time\n", origin_x, origin_y);
+      }
     }
   }
 
@@ -1,13 +1,23 @@
 #include "xdo_cmd.h"
 #include <string.h>
 
+/* Where search results go as they are found. */
+typedef struct search_results {
+  int print;
+  Window *list;
+  unsigned int nwindows;
+  unsigned int size;
+} search_results_t;
+
+static int search_found(const xdo_t *xdo, Window window, void *data);
+
 int cmd_search(context_t *context) {
-  Window *list = NULL;
+  search_results_t results = { 0, NULL, 0, 0 };
   xdo_search_t search;
-  unsigned int nwindows;
-  unsigned int i;
+  xdo_search_plan_t *plan;
   int c;
   int op_sync = False;
+  int own_index = False;
 
   int search_title = 0;
   int search_name = 0;
@@ -20,7 +30,7 @@ int cmd_search(context_t *context) {
     opt_unused, opt_title, opt_onlyvisible, opt_name, opt_shell, opt_prefix, opt_class, opt_maxdepth,
     opt_pid, opt_help, opt_any, opt_all, opt_screen, opt_classname, opt_desktop,
     opt_limit, opt_sync
-    ,opt_role
+    ,opt_role, opt_stacking, opt_parallel, opt_tree
   } optlist_t;
   struct option longopts[] = {
     { "all", no_argument, NULL, opt_all },
@@ -40,6 +50,9 @@ int cmd_search(context_t *context) {
     { "limit", required_argument, NULL, opt_limit },
     { "sync", no_argument, NULL, opt_sync },
     { "role", no_argument, NULL, opt_role },
+    { "stacking", no_argument, NULL, opt_stacking },
+    { "parallel", no_argument, NULL, opt_parallel },
+    { "tree", no_argument, NULL, opt_tree },
     { 0, 0, 0, 0 },
   };
   static const char *usage =
@@ -56,6 +69,10 @@ int cmd_search(context_t *context) {
       "--screen N      only search a specific screen. Default is all screens\n"
       "--desktop N     only search a specific desktop number\n"
       "--limit N       break search after N results\n"
+      "--stacking      report windows in stacking order, bottom-most first\n"
+      "--parallel      search each screen at the same time\n"
+      "--tree          search the whole window tree, not just the\n"
+      "                window manager's client list\n"
       "--name          check regexp_pattern against the window name\n"
       "--shell         print results as shell array WINDOWS=( ... )\n"
       "--prefix STR    use prefix (max 16 chars) for array name STRWINDOWS\n"
@@ -139,6 +156,15 @@ int cmd_search(context_t *context) {
       case opt_sync:
         op_sync = True;
         break;
+      case opt_stacking:
+        search.searchmask |= SEARCH_STACKING;
+        break;
+      case opt_parallel:
+        search.searchmask |= SEARCH_PARALLEL;
+        break;
+      case opt_tree:
+        search.searchmask |= SEARCH_TREE;
+        break;
       default:
         fprintf(stderr, "Invalid usage\n");
         fprintf(stderr, usage, cmd);
@@ -190,38 +216,71 @@ int cmd_search(context_t *context) {
     consume_args(context, 1);
   }
 
-  do {
-    if (list != NULL) {
-      free(list);
-    }
+  /* Compile the search once; --sync may run it many times. */
+  plan = xdo_search_plan_new(context->xdo, &search);
+  if (plan == NULL) {
+    return EXIT_FAILURE;
+  }
 
-    xdo_search_windows(context->xdo, &search, &list, &nwindows);
+  /* only print if we're the last command or printing to shell*/
+  results.print = (context->argc == 0) || out_shell;
 
-    if ( (context->argc == 0) || out_shell ) {
-      /* only print if we're the last command or printing to shell*/
-      if (out_shell) printf("%s%s", out_prefix, "WINDOWS=(");
-      for (i = 0; i < nwindows; i++) {
-        window_print(list[i]);
-      }
-      if (out_shell) printf("%s",")\n");
-    }
+  /* With --sync, keep an index of the windows, so that the search is only
+   * run again when a window changes, and then without asking the server
+   * anything. */
+  if (op_sync && context->xdo->window_index == NULL) {
+    xdo_enable_window_index(context->xdo);
+    own_index = True;
+  }
 
-    if (op_sync && nwindows == 0) {
-      xdotool_debug(context, "No search results, still waiting...");
+  /* Print each window as soon as it is found. With --sync, the searches
+   * that find nothing print nothing, so there is only the one array. */
+  if (out_shell) printf("%s%s", out_prefix, "WINDOWS=(");
+  do {
+    results.nwindows = 0;
+    xdo_search_plan_foreach(plan, search_found, &results);
 
-      /* TODO(sissel): Make this tunable */
-      usleep(500000);
+    /* Only search again once a window that could match has changed. */
+    if (op_sync && results.nwindows == 0) {
+      xdotool_debug(context, "No search results, still waiting...");
+      xdo_search_plan_wait(plan, 0);
     }
-  } while (op_sync && nwindows == 0);
+  } while (op_sync && results.nwindows == 0);
+  if (out_shell) printf("%s",")\n");
+
+  if (own_index)
+    xdo_disable_window_index(context->xdo);
 
-  /* Free old list as it's malloc'd by xdo_search_windows */
+  xdo_search_plan_free(plan);
+
+  /* Free old list as it's malloc'd by search_found */
   if (context->windows != NULL) {
     free(context->windows);
   }
-  context->windows = list;
-  context->nwindows = nwindows;
+  context->windows = results.list;
+  context->nwindows = results.nwindows;
 
   /* error if number of windows found is zero (behave like grep)
   but return success when being used inside eval (--shell option)*/
-  return (nwindows || out_shell ? EXIT_SUCCESS : EXIT_FAILURE);
+  return (results.nwindows || out_shell ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static int search_found(const xdo_t *xdo, Window window, void *data) {
+  search_results_t *results = data;
+
+  (void)xdo;
+
+  if (results->print) {
+    window_print(window);
+    fflush(stdout);
+  }
+
+  /* Keep the window for the commands that follow. */
+  if (results->nwindows == results->size) {
+    results->size = results->size ? results->size * 2 : 100;
+    results->list = realloc(results->list, results->size * sizeof(Window));
+  }
+  results->list[results->nwindows++] = window;
+
+  return XDO_SEARCH_CONTINUE;
 }
@@ -132,22 +132,32 @@ int cmd_select(context_t *context) {
   consume_args(context, optind);
 
   int nwindows;
+  int own_index = 0;
   Window *list = NULL;
 
+  /* Waiting on the window index means selecting again only when a window
+   * that could be selected has changed, and then without asking the server
+   * anything. */
+  if (do_sync == 1 && context->xdo->window_index == NULL) {
+    xdo_enable_window_index(context->xdo);
+    own_index = 1;
+  }
+
   while (1) {
     xdo_select_windows(selection, &list, &nwindows);
 
     if (do_sync == 1 && nwindows == 0) {
       free(list);
-
-      /* TODO: Make this tunable. */
-      usleep(500000);
+      xdo_select_wait(selection, 0);
       continue;
     }
 
     break;
   }
 
+  if (own_index == 1)
+    xdo_disable_window_index(context->xdo);
+
   if (context->argc == 0) {
     int i;
     /* Only print if the last command. */
@@ -2,6 +2,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* How much of --file to read at a time. Typing starts as soon as the first
+ * piece arrives, and no more than this much is ever held in memory. */
+#define TYPE_FILE_CHUNK 4096
+
+static int type_keys(context_t *context, const char *window_arg,
+                     const xdo_key_buffer_t *keys);
 
 int cmd_type(context_t *context) {
   int ret = 0;
@@ -13,16 +22,16 @@ int cmd_type(context_t *context) {
   char *terminator = NULL;
   char *file = NULL;
 
-  FILE *input = NULL;
-  char *buffer = NULL;
-  char *marker = NULL;
-  size_t bytes_read = 0;
+  int input = -1;
+  char chunk[TYPE_FILE_CHUNK];
+  ssize_t bytes_read;
 
   char **data = NULL; /* stuff to type */
+  xdo_key_buffer_t *keys = NULL;
+  charcodemap_t *active_mods = NULL;
+  int active_mods_n = 0;
   int data_count = 0;
   int args_count = 0;
-  charcodemap_t *active_mods = NULL;
-  int active_mods_n;
 
   /* Options */
   int clear_modifiers = 0;
@@ -116,49 +125,20 @@ int cmd_type(context_t *context) {
   }
 
   if (file != NULL) {
-    data = calloc(1 + context->argc, sizeof(char *));
-
     /* determine whether reading from a file or from stdin */
     if (!strcmp(file, "-")) {
-      input = fdopen(0, "r");
+      input = 0;
     } else {
-      input = fopen(file, "r");
-      if (input == NULL) {
+      input = open(file, O_RDONLY);
+      if (input == -1) {
         fprintf(stderr, "Failure opening '%s': %s\n", file, strerror(errno));
         return EXIT_FAILURE;
       }
     }
-
-    while (feof(input) == 0) {
-      marker = realloc(buffer, bytes_read + 4096);
-      if (marker == NULL) {
-        fprintf(stderr, "Failure allocating for '%s': %s\n", file, strerror(errno));
-        return EXIT_FAILURE;
-      }
-
-      buffer = marker;
-      marker = buffer + bytes_read;
-      if (fgets(marker, 4096, input) != NULL) {
-        bytes_read = (marker - buffer) + strlen(marker);
-      } else {
-        *marker = 0;
-      }
-
-      if (ferror(input) != 0) {
-        fprintf(stderr, "Failure reading '%s': %s\n", file, strerror(errno));
-        return EXIT_FAILURE;
-      }
-    }
-
-    data[0] = buffer;
-    data_count++;
-
-    fclose(input);
-  }
-  else {
-    data = calloc(context->argc, sizeof(char *));
   }
 
+  data = calloc(1 + context->argc, sizeof(char *));
+
   /* Apply any --arity or --terminator */
   for (i=0; i < context->argc; i++) {
     if (arity > 0 && i == arity) {
@@ -179,31 +159,104 @@ int cmd_type(context_t *context) {
     args_count++;
   }
 
-  window_each(context, window_arg, {
-    if (clear_modifiers) {
-      xdo_get_active_modifiers(context->xdo, &active_mods, &active_mods_n);
-      xdo_clear_active_modifiers(context->xdo, window, active_mods, active_mods_n);
-    }
+  /* Keys for a given window only go through XTest while it has focus;
+   * watch for focus changes rather than asking before every key. */
+  if (window_arg != NULL) {
+    xdo_enable_focus_tracking(context->xdo);
+  }
 
-    for (i = 0; i < data_count; i++) {
-      //printf("Typing: '%s'\n", context->argv[i]);
-      int tmp = xdo_enter_text_window(context->xdo, window, data[i], delay);
+  /* Work out the keys for the text up front rather than character by
+   * character while typing it to each window. */
+  keys = xdo_key_buffer_new(context->xdo, delay);
+
+  /* Clear the modifiers once for all of the typing, not for every piece of
+   * the file. */
+  if (clear_modifiers) {
+    xdo_get_active_modifiers(context->xdo, &active_mods, &active_mods_n);
+    window_each(context, window_arg, {
+      xdo_clear_active_modifiers(context->xdo, window, active_mods,
+                                 active_mods_n);
+    }); /* window_each(...) */
+  }
 
-      if (tmp) {
-        fprintf(stderr, "xdo_enter_text_window reported an error\n");
+  /* Type the file a piece at a time, as it is read. With several windows,
+   * each piece goes to every window in turn before the next is read. */
+  if (input != -1) {
+    while ((bytes_read = read(input, chunk, sizeof(chunk))) != 0) {
+      if (bytes_read == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        fprintf(stderr, "Failure reading '%s': %s\n", file, strerror(errno));
+        ret++;
+        break;
       }
 
-      ret += tmp;
+      if (xdo_key_buffer_add_bytes(keys, chunk, bytes_read)) {
+        fprintf(stderr, "xdo_key_buffer_add_bytes reported an error\n");
+        ret++;
+        break;
+      }
+
+      ret += type_keys(context, window_arg, keys);
+      xdo_key_buffer_clear(keys);
     }
 
-    if (clear_modifiers) {
-      xdo_set_active_modifiers(context->xdo, window, active_mods, active_mods_n);
-      free(active_mods);
+    /* Complains if the file ended partway through a character. */
+    ret += xdo_key_buffer_finish(keys);
+
+    if (input != 0) {
+      close(input);
     }
-  }); /* window_each(...) */
+  }
+
+  for (i = 0; i < data_count; i++) {
+    int tmp = xdo_key_buffer_add_text(keys, data[i]);
 
+    if (tmp) {
+      fprintf(stderr, "xdo_key_buffer_add_text reported an error\n");
+    }
+
+    ret += tmp;
+  }
+
+  if (data_count > 0) {
+    ret += type_keys(context, window_arg, keys);
+  }
+
+  if (clear_modifiers) {
+    window_each(context, window_arg, {
+      xdo_set_active_modifiers(context->xdo, window, active_mods,
+                               active_mods_n);
+    }); /* window_each(...) */
+    free(active_mods);
+  }
+
+  if (window_arg != NULL) {
+    xdo_disable_focus_tracking(context->xdo);
+  }
+
+  xdo_key_buffer_free(keys);
   free(data);
 
   consume_args(context, args_count);
   return ret > 0;
 }
+
+static int type_keys(context_t *context, const char *window_arg,
+                     const xdo_key_buffer_t *keys) {
+  int ret = 0;
+
+  window_each(context, window_arg, {
+    int tmp = xdo_key_buffer_play(keys, window);
+
+    if (tmp) {
+      fprintf(stderr, "xdo_key_buffer_play reported an error\n");
+    }
+
+    ret += tmp;
+  }); /* window_each(...) */
+
+  return ret;
+}
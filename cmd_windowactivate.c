@@ -2,6 +2,7 @@
 
 int cmd_windowactivate(context_t *context) {
   int ret = 0;
+  int sync_failed = 0;
   char *cmd = *context->argv;
   const char *window_arg = "%1";
   int opsync = 0;
@@ -53,11 +54,13 @@ int cmd_windowactivate(context_t *context) {
               window);
       return ret;
     } else {
-      if (opsync) {
-        xdo_wait_for_window_active(context->xdo, window, 1);
+      if (opsync && xdo_wait_for_window_active(context->xdo, window, 1)) {
+        fprintf(stderr, "windowactivate: window %ld was not activated in "
+                "time\n", window);
+        sync_failed = 1;
       }
     }
   }); /* window_each(...) */
 
-  return ret;
+  return sync_failed ? EXIT_FAILURE : ret;
 }
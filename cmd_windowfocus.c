@@ -2,6 +2,7 @@
 
 int cmd_windowfocus(context_t *context) {
   int ret = 0;
+  int sync_failed = 0;
   char *cmd = *context->argv;
   int opsync = 0;
 
@@ -51,11 +52,13 @@ int cmd_windowfocus(context_t *context) {
       fprintf(stderr, "xdo_focus_window reported an error\n");
       return ret;
     } else {
-      if (opsync) {
-        xdo_wait_for_window_focus(context->xdo, window, 1);
+      if (opsync && xdo_wait_for_window_focus(context->xdo, window, 1)) {
+        fprintf(stderr, "windowfocus: window %ld did not get focus in time\n",
+                window);
+        sync_failed = 1;
       }
     }
   }); /* window_each(...) */
 
-  return ret;
+  return sync_failed ? EXIT_FAILURE : ret;
 }
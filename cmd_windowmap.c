@@ -2,6 +2,7 @@
 
 int cmd_windowmap(context_t *context) {
   int ret = 0;
+  int sync_failed = 0;
   char *cmd = *context->argv;
   const char *window_arg = "%1";
   int opsync = 0;
@@ -51,11 +52,14 @@ int cmd_windowmap(context_t *context) {
     if (ret) {
       fprintf(stderr, "xdo_map_window reported an error\n");
     } else {
-      if (opsync) {
-        xdo_wait_for_window_map_state(context->xdo, window, IsViewable);
+      if (opsync
+          && xdo_wait_for_window_map_state(context->xdo, window, IsViewable)) {
+        fprintf(stderr, "windowmap: window %ld was not mapped in time\n",
+                window);
+        sync_failed = 1;
       }
     }
   }); /* window_each(...) */
 
-  return ret;
+  return sync_failed ? EXIT_FAILURE : ret;
 }
@@ -3,6 +3,7 @@
 
 int cmd_windowminimize(context_t *context) {
   int ret = 0;
+  int sync_failed = 0;
   char *cmd = *context->argv;
   const char *window_arg = "%1";
   int opsync = 0;
@@ -52,11 +53,14 @@ int cmd_windowminimize(context_t *context) {
     if (ret) {
       fprintf(stderr, "xdo_minimize_window reported an error\n");
     } else {
-      if (opsync) {
-        xdo_wait_for_window_map_state(context->xdo, window, IsUnmapped);
+      if (opsync
+          && xdo_wait_for_window_map_state(context->xdo, window, IsUnmapped)) {
+        fprintf(stderr, "windowminimize: window %ld was not minimized in "
+                "time\n", window);
+        sync_failed = 1;
       }
     }
   }); /* window_each(...) */
 
-  return ret;
+  return sync_failed ? EXIT_FAILURE : ret;
 }
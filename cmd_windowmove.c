@@ -10,6 +10,7 @@ struct windowmove {
   int x;
   int y;
   int opsync;
+  int timeout;  /* for --sync, in milliseconds; -1 for the default */
   int flags;
 };
 
@@ -69,6 +70,7 @@ int cmd_windowmove(context_t *context) {
   windowmove.x = 0;
   windowmove.y = 0;
   windowmove.opsync = 0;
+  windowmove.timeout = -1;
   windowmove.window = CURRENTWINDOW;
   windowmove.flags = 0;
   windowmove.gravity = 0;
@@ -78,12 +80,14 @@ int cmd_windowmove(context_t *context) {
     opt_gravity,
     opt_relative,
     opt_sync,
+    opt_timeout,
     opt_help_gravity,
     opt_help,
   } optlist_t;
   static struct option longopts[] = {
     { "gravity", required_argument, NULL, opt_gravity },
     { "sync", no_argument, NULL, opt_sync },
+    { "timeout", required_argument, NULL, opt_timeout },
     { "relative", no_argument, NULL, opt_relative },
     { "help-gravity", no_argument, NULL, opt_help_gravity },
     { "help", no_argument, NULL, opt_help },
@@ -94,6 +98,7 @@ int cmd_windowmove(context_t *context) {
     "--gravity <g>       specify a gravity for the movement\n"
     "                    see --help-gravity for values\n"
     "--sync              only exit once the window has moved\n"
+    "--timeout <ms>      with --sync, give up after this long (default 15000)\n"
     "--relative          move relative to window position\n"
     "-h/--help           display this help and exit\n"
     "\n"
@@ -120,6 +125,10 @@ int cmd_windowmove(context_t *context) {
       case opt_sync:
         windowmove.opsync = 1;
         break;
+      case opt_timeout:
+        if (!parse_timeout(cmd, optarg, &windowmove.timeout))
+          return EXIT_FAILURE;
+        break;
       case opt_help_gravity:
         puts(HELP_GRAVITY);
         consume_args(context, context->argc);
@@ -196,7 +205,8 @@ int cmd_windowmove(context_t *context) {
         }
       }
       windowmove.window = window;
-      _windowmove(context, &windowmove);
+      if (_windowmove(context, &windowmove) != XDO_SUCCESS)
+        ret = EXIT_FAILURE;
     }); /* window_each(...) */
   return ret;
 }
@@ -244,24 +254,35 @@ static int _windowmove(context_t *context, struct windowmove *windowmove) {
     fprintf(stderr,
             "xdo_move_window reported an error while moving window %ld\n",
             windowmove->window);
-  } else {
-    if (windowmove->opsync) {
-      /* This 'sync' request is stateful (we need to know the original window
-       * location to make the decision about 'done'
-       * Some window managers force alignments or otherwise mangle move
-       * requests, so we can't just look for the x,y positions exactly.
-       * Just look for any change in the window's position. */
-      int win_x, win_y;
+  } else if (windowmove->opsync
+             /* Permit imprecision to account for window borders and
+              * titlebar on each axis; a move within that on both axes
+              * may not move the window at all. */
+             && (abs(target_x - orig_win_x) > 10
+                 || abs(target_y - orig_win_y) > 50)) {
+    /* This 'sync' request is stateful (we need to know the original window
+     * location to make the decision about 'done'
+     * Some window managers force alignments or otherwise mangle move
+     * requests, so we can't just look for the x,y positions exactly.
+     * Just look for any change in the window's position. */
+    int timeout = context->xdo->wait_timeout;
+    int win_x, win_y;
+
+    if (windowmove->timeout >= 0)
+      context->xdo->wait_timeout = windowmove->timeout;
+    ret = xdo_wait_for_window_move_from(context->xdo, windowmove->window,
+                                        orig_win_x, orig_win_y);
+    context->xdo->wait_timeout = timeout;
+
+    if (ret) {
+      fprintf(stderr, "windowmove: window %ld did not move from %d,%d "
+              "(asked for %d,%d)\n", windowmove->window, orig_win_x,
+              orig_win_y, target_x, target_y);
+    } else if (context->debug) {
       xdo_get_window_location(context->xdo, windowmove->window,
                               &win_x, &win_y, NULL);
-      /* Permit imprecision to account for window borders and titlebar */
-      while (orig_win_x == win_x && orig_win_y == win_y
-             && abs(windowmove->x - win_x) > 10
-             && abs(windowmove->y - win_y) > 50) {
-        xdo_get_window_location(context->xdo, windowmove->window,
-                                &win_x, &win_y, NULL);
-        usleep(30000);
-      }
+      xdotool_debug(context, "Window %ld moved to %d,%d",
+                    windowmove->window, win_x, win_y);
     }
   }
 
@@ -3,19 +3,22 @@
 
 int cmd_windowsize(context_t *context) {
   int ret = 0;
+  int sync_failed = 0;
   unsigned int width, height;
   int is_width_percent = 0, is_height_percent = 0;
   int c;
   int opsync = 0;
+  int timeout = -1;
 
   int use_hints = 0;
   typedef enum {
-    opt_unused, opt_help, opt_usehints, opt_sync
+    opt_unused, opt_help, opt_usehints, opt_sync, opt_timeout
   } optlist_t;
   struct option longopts[] = {
     { "usehints", 0, NULL, opt_usehints },
     { "help", no_argument, NULL, opt_help },
     { "sync", no_argument, NULL, opt_sync },
+    { "timeout", required_argument, NULL, opt_timeout },
     { 0, 0, 0, 0 },
   };
 
@@ -26,7 +29,9 @@ int cmd_windowsize(context_t *context) {
             "Usage: %s [--sync] [--usehints] [window=%1] width height\n"
             HELP_SEE_WINDOW_STACK
             "--usehints  - Use window sizing hints (like font size in terminals)\n"
-            "--sync      - only exit once the window has resized\n";
+            "--sync      - only exit once the window has resized\n"
+            "--timeout <ms> - with --sync, give up after this long "
+            "(default 15000)\n";
 
   while ((c = getopt_long_only(context->argc, context->argv, "+uh",
                                longopts, &option_index)) != -1) {
@@ -43,6 +48,10 @@ int cmd_windowsize(context_t *context) {
       case opt_sync:
         opsync = 1;
         break;
+      case opt_timeout:
+        if (!parse_timeout(cmd, optarg, &timeout))
+          return EXIT_FAILURE;
+        break;
       default:
         fprintf(stderr, usage, cmd);
         return EXIT_FAILURE;
@@ -126,12 +135,33 @@ int cmd_windowsize(context_t *context) {
       return ret;
     }
     if (opsync) {
+      int default_timeout = context->xdo->wait_timeout;
+      /* No commas here, this is inside the window_each macro. */
+      unsigned int final_w;
+      unsigned int final_h;
+
+      if (timeout >= 0)
+        context->xdo->wait_timeout = timeout;
       //xdo_wait_for_window_size(context->xdo, window, width, height, 0,
                                //SIZE_TO);
-      xdo_wait_for_window_size(context->xdo, window, original_w, original_h, 0,
-                               SIZE_FROM);
+      ret = xdo_wait_for_window_size(context->xdo, window, original_w,
+                                     original_h, 0, SIZE_FROM);
+      context->xdo->wait_timeout = default_timeout;
+
+      if (ret) {
+        xdo_get_window_size(context->xdo, window, &final_w, &final_h);
+        fprintf(stderr, "windowsize: window %ld is %ux%u "
+                "(asked for %ux%u)\n", window, final_w, final_h,
+                width, height);
+        /* Keep going with the rest of the window stack, like windowmove. */
+        sync_failed = 1;
+      } else if (context->debug) {
+        xdo_get_window_size(context->xdo, window, &final_w, &final_h);
+        xdotool_debug(context, "Window %ld resized to %ux%u",
+                      window, final_w, final_h);
+      }
     }
   }); /* window_each(...) */
 
-  return ret;
+  return sync_failed ? EXIT_FAILURE : ret;
 }
@@ -2,9 +2,10 @@
 
 int cmd_windowunmap(context_t *context) {
   int ret = 0;
+  int sync_failed = 0;
   char *cmd = *context->argv;
   const char *window_arg = "%1";
-  int opsync;
+  int opsync = 0;
 
   int c;
   typedef enum {
@@ -52,10 +53,13 @@ int cmd_windowunmap(context_t *context) {
       fprintf(stderr, "xdo_unmap_window reported an error\n");
     }
 
-    if (opsync) {
-      xdo_wait_for_window_map_state(context->xdo, window, IsUnmapped);
+    if (opsync
+        && xdo_wait_for_window_map_state(context->xdo, window, IsUnmapped)) {
+      fprintf(stderr, "windowunmap: window %ld was not unmapped in time\n",
+              window);
+      sync_failed = 1;
     }
   }); /* window_each(...) */
 
-  return ret;
+  return sync_failed ? EXIT_FAILURE : ret;
 }
@@ -0,0 +1,109 @@
+#!/bin/sh
+# Time xdotool commands against a few thousand windows.
+#
+# Run it under a throwaway X server with two screens:
+#   make benchmark
+# To compare two builds, run it once for each:
+#   XDOTOOL=/path/to/other/boxdotool make benchmark
+#
+# Each case runs ROUNDS times (default 20) and prints the average wall
+# time of one run in milliseconds. In a case, $i is the round number.
+
+XDOTOOL=${XDOTOOL:-../boxdotool}
+ROUNDS=${ROUNDS:-20}
+WINDOWS=${WINDOWS:-500}
+
+bench() {
+  name=$1
+  shift
+
+  i=0
+  start=$(date +%s%N)
+  while [ $i -lt $ROUNDS ] ; do
+    eval "$@" > /dev/null 2>&1
+    i=$((i + 1))
+  done
+  end=$(date +%s%N)
+
+  echo "$name $start $end $ROUNDS" \
+    | awk '{ printf("%-44s %9.2f ms\n", $1, ($3 - $2) / $4 / 1000000) }'
+}
+
+if [ ! -x manywindows ] || [ manywindows.c -nt manywindows ] ; then
+  cc -o manywindows manywindows.c -lX11 || exit 1
+fi
+
+ready=$(mktemp)
+./manywindows $WINDOWS > $ready &
+windowspid=$!
+trap 'kill $windowspid; rm -f $ready' EXIT
+until grep -q ready $ready ; do
+  kill -0 $windowspid 2> /dev/null || exit 1
+  sleep 0.1
+done
+
+echo "$XDOTOOL, $WINDOWS windows per screen, $ROUNDS rounds"
+
+# Something to type: ASCII, Latin-1 and a character no key has.
+text=""
+for n in 1 2 3 4 5 6 7 8 9 10 ; do
+  text="${text}The quick brown fox jumps over the lazy dog. Ça coûte 5€. "
+done
+window=$($XDOTOOL search --limit 1 --name '^bench-0$')
+
+# Search plans: the patterns are compiled once, not once per window.
+bench search-regex-name \
+  "$XDOTOOL search --name 'bench-4[0-9]+\$'"
+bench search-regex-class-and-name \
+  "$XDOTOOL search --all --class '^Bench\$' --name 'bench-1[0-9]*\$'"
+
+# One record per window, fetched once for all of the criteria. Nothing
+# matches, so every criterion is tested on every window.
+bench search-any-four-criteria \
+  "$XDOTOOL search --any --name nomatch --class nomatch --classname nomatch --role nomatch"
+
+# Plain and anchored patterns are compared without regexec.
+bench search-literal-name \
+  "$XDOTOOL search --name bench-499"
+bench search-anchored-name \
+  "$XDOTOOL search --name '^bench-499\$'"
+bench search-regex-name-same-matches \
+  "$XDOTOOL search --name 'bench-49[9]'"
+
+# Each screen searched on its own connection and thread.
+bench search-all-screens \
+  "$XDOTOOL search --name bench-1"
+bench search-all-screens-parallel \
+  "$XDOTOOL search --parallel --name bench-1"
+
+# Characters found by table rather than by scanning the charcode map. To
+# a window without focus, so the keys go out with XSendEvent.
+bench type-to-window \
+  "$XDOTOOL type --delay 0 --window $window '$text'"
+
+# XTest key events queued and flushed together rather than synced one by
+# one.
+bench type-xtest \
+  "$XDOTOOL type --delay 0 '$text'"
+
+# Commands that never send a key don't build the charcode map.
+bench getmouselocation \
+  "$XDOTOOL getmouselocation"
+bench getwindowname \
+  "$XDOTOOL getwindowname $window"
+
+# --sync waits for the ConfigureNotify. Every round asks for a change, so
+# every round waits.
+bench windowmove-sync \
+  "$XDOTOOL windowmove --sync $window \$((i % 2 * 100)) \$((i % 2 * 100))"
+bench windowsize-sync \
+  "$XDOTOOL windowsize --sync $window \$((10 + i % 2 * 10)) 10"
+
+# The matching on its own, without the X server: literal patterns, matched
+# the way search does, against regexec over the titles in titles.txt.
+if [ ! -x patternmatch ] || [ patternmatch.c -nt patternmatch ] ; then
+  cc -O2 -I.. -o patternmatch patternmatch.c ../xdo.c ../xdo_index.c \
+    ../xdo_select.c `pkg-config --cflags --libs x11 x11-xcb xcb xtst \
+    xinerama xkbcommon` -lpthread -lm || exit 1
+fi
+./patternmatch --bench titles.txt
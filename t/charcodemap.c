@@ -0,0 +1,67 @@
+/* Build with:
+ * gcc -I.. -DHAVE_XKBCOMMON_X11 charcodemap.c ../xdo_index.c ../xdo_search.c \
+ *   ../xdo_select.c -lX11 -lX11-xcb -lxcb -lXtst -lXinerama -lxkbcommon \
+ *   -lxkbcommon-x11 -lpthread -lm
+ *
+ * Builds the charcode map with xkbcommon-x11 and with Xlib and prints every
+ * entry where the two differ. Exits 0 if they are the same, 2 if the map
+ * could not be built with xkbcommon-x11 at all.
+ */
+
+/* Yes, I know including .c files is insanity. */
+#include "xdo.c"
+
+int main(void) {
+  xdo_t *xdo = NULL;
+  charcodemap_t *xkb;
+  int xkb_len, xkb_width;
+  int i, len, differences = 0;
+
+  xdo = xdo_new(NULL);
+  if (xdo == NULL) {
+    fprintf(stderr, "Unable to open the display\n");
+    return 2;
+  }
+
+  if (!_xdo_populate_charcode_map_xkbcommon(xdo)) {
+    fprintf(stderr, "xkbcommon-x11 keymap unavailable\n");
+    xdo_free(xdo);
+    return 2;
+  }
+  xkb = xdo->charcodes;
+  xkb_len = xdo->charcodes_len;
+  xkb_width = xdo->keysyms_per_keycode;
+
+  xdo->charcodes = NULL;
+  _xdo_populate_charcode_map_xlib(xdo);
+
+  if (xkb_width != xdo->keysyms_per_keycode) {
+    printf("keysyms_per_keycode: xkbcommon %d, xlib %d\n",
+           xkb_width, xdo->keysyms_per_keycode);
+    differences++;
+  }
+
+  if (xkb_len != xdo->charcodes_len) {
+    printf("entries: xkbcommon %d, xlib %d\n", xkb_len, xdo->charcodes_len);
+    differences++;
+  }
+
+  len = xkb_len < xdo->charcodes_len ? xkb_len : xdo->charcodes_len;
+  for (i = 0; i < len; i++) {
+    const charcodemap_t *a = &xkb[i];
+    const charcodemap_t *b = &xdo->charcodes[i];
+
+    if (a->key != b->key || a->code != b->code || a->symbol != b->symbol
+        || a->group != b->group || a->modmask != b->modmask) {
+      printf("%d: xkbcommon code %d group %d sym 0x%lx mods 0x%x, "
+             "xlib code %d group %d sym 0x%lx mods 0x%x\n", i,
+             a->code, a->group, (unsigned long)a->symbol, a->modmask,
+             b->code, b->group, (unsigned long)b->symbol, b->modmask);
+      differences++;
+    }
+  }
+
+  free(xkb);
+  xdo_free(xdo);
+  return differences == 0 ? 0 : 1;
+}
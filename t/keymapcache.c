@@ -0,0 +1,218 @@
+/* Build with:
+ * gcc -I.. keymapcache.c ../xdo_index.c ../xdo_search.c ../xdo_select.c \
+ *   -lX11 -lX11-xcb -lxcb -lXtst -lXinerama -lxkbcommon -lpthread -lm
+ *
+ * Usage: keymapcache FILE
+ *
+ * Writes a keymap cache (see xdo_enable_keymap_cache) to FILE, then damages
+ * it in every way we can think of and changes the keymap under it. Each
+ * time, checks that the file is passed over, that the charcode map is read
+ * from the server again and comes out the same as without a cache, and
+ * that the file is good again afterwards. Prints what went wrong and exits
+ * 1 if anything did.
+ */
+
+#include <stddef.h>
+
+/* Yes, I know including .c files is insanity. */
+#include "xdo.c"
+
+static const char *file;
+static charcodemap_t *live;
+static int live_len;
+static int differences;
+
+static xdo_t *open_xdo(int cached) {
+  xdo_t *xdo = xdo_new(NULL);
+
+  if (xdo == NULL) {
+    fprintf(stderr, "Unable to open the display\n");
+    exit(2);
+  }
+  if (cached)
+    xdo_enable_keymap_cache(xdo, file);
+  return xdo;
+}
+
+/* Read the charcode map from the server, the way it's done with no cache,
+ * to compare the others against. */
+static void read_live_map(void) {
+  xdo_t *xdo = open_xdo(False);
+
+  _xdo_need_charcode_map(xdo);
+  free(live);
+  live_len = xdo->charcodes_len;
+  live = malloc(live_len * sizeof(charcodemap_t));
+  memcpy(live, xdo->charcodes, live_len * sizeof(charcodemap_t));
+  xdo_free(xdo);
+}
+
+static int same_as_live(const xdo_t *xdo) {
+  int i;
+
+  if (xdo->charcodes_len != live_len)
+    return False;
+  for (i = 0; i < live_len; i++) {
+    const charcodemap_t *a = &xdo->charcodes[i];
+    const charcodemap_t *b = &live[i];
+
+    if (a->key != b->key || a->code != b->code || a->symbol != b->symbol
+        || a->group != b->group || a->modmask != b->modmask)
+      return False;
+  }
+  return True;
+}
+
+/* Build the charcode map with the cache on, and check whether it came from
+ * the file and that it's the server's. */
+static void expect(const char *what, int from_file) {
+  xdo_t *xdo = open_xdo(True);
+  int used;
+
+  _xdo_need_charcode_map(xdo);
+  used = (xdo->keymap_cache->mapped != NULL);
+  if (used != from_file) {
+    printf("%s: the cache file was %s\n", what, used ? "used" : "not used");
+    differences++;
+  }
+  if (!same_as_live(xdo)) {
+    printf("%s: the charcode map is not the server's\n", what);
+    differences++;
+  }
+  xdo_free(xdo);
+}
+
+/* Damage the file, then check that it is passed over and written again. */
+static void expect_rejected(const char *what) {
+  expect(what, False);
+  expect(what, True);
+}
+
+static size_t file_size(void) {
+  struct stat st;
+
+  if (stat(file, &st) == -1) {
+    perror(file);
+    exit(1);
+  }
+  return st.st_size;
+}
+
+static void truncate_to(const char *what, size_t size) {
+  if (truncate(file, size) == -1) {
+    perror(file);
+    exit(1);
+  }
+  expect_rejected(what);
+}
+
+static void flip_byte(const char *what, size_t offset) {
+  unsigned char byte;
+  FILE *fp = fopen(file, "r+b");
+
+  if (fp == NULL || fseek(fp, offset, SEEK_SET) != 0
+      || fread(&byte, 1, 1, fp) != 1) {
+    perror(file);
+    exit(1);
+  }
+  byte ^= 0x01;
+  if (fseek(fp, offset, SEEK_SET) != 0 || fwrite(&byte, 1, 1, fp) != 1
+      || fclose(fp) != 0) {
+    perror(file);
+    exit(1);
+  }
+  expect_rejected(what);
+}
+
+static void append_byte(const char *what) {
+  FILE *fp = fopen(file, "ab");
+
+  if (fp == NULL || fputc(0, fp) == EOF || fclose(fp) != 0) {
+    perror(file);
+    exit(1);
+  }
+  expect_rejected(what);
+}
+
+/* Put another keysym on the last keycode, from another client, as xmodmap
+ * would, or put back the width keysyms in restore. Returns what was there
+ * before, and sets width to how many keysyms that is. */
+static KeySym *change_keymap(KeySym *restore, int *width) {
+  Display *dpy = XOpenDisplay(NULL);
+  int low, high, old_width;
+  KeySym *keysyms;
+  KeySym changed;
+
+  XDisplayKeycodes(dpy, &low, &high);
+  keysyms = XGetKeyboardMapping(dpy, high, 1, &old_width);
+  if (restore == NULL) {
+    changed = (keysyms[0] == XK_F35) ? XK_F34 : XK_F35;
+    XChangeKeyboardMapping(dpy, high, 1, &changed, 1);
+  } else {
+    XChangeKeyboardMapping(dpy, high, *width, restore, 1);
+  }
+  XSync(dpy, False);
+  XCloseDisplay(dpy);
+  *width = old_width;
+  return keysyms;
+}
+
+int main(int argc, char **argv) {
+  const size_t charcodes = KEYMAP_CACHE_CHARCODES;
+  KeySym *original;
+  int width;
+  size_t size;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+    return 2;
+  }
+  file = argv[1];
+  unlink(file);
+
+  read_live_map();
+  expect("no file yet", False);
+  expect("a good file", True);
+  size = file_size();
+
+  truncate_to("an empty file", 0);
+  truncate_to("half a header", charcodes / 2);
+  truncate_to("only a header", charcodes);
+  truncate_to("half the file", size / 2);
+  truncate_to("the last byte cut off", size - 1);
+  append_byte("a byte too many");
+
+  flip_byte("a bad magic", offsetof(struct keymap_cache_header, magic));
+  flip_byte("another version", offsetof(struct keymap_cache_header, version));
+  flip_byte("another fingerprint",
+            offsetof(struct keymap_cache_header, fingerprint));
+  flip_byte("a bad checksum", offsetof(struct keymap_cache_header, checksum));
+  flip_byte("a bad length",
+            offsetof(struct keymap_cache_header, charcodes_len));
+  flip_byte("a bad table size", offsetof(struct keymap_cache_header, mask));
+  flip_byte("a bad latin table entry",
+            offsetof(struct keymap_cache_header, latin_chars)
+            + 'a' * sizeof(int));
+  flip_byte("a bad keycode", charcodes + offsetof(charcodemap_t, code));
+  flip_byte("a bad keysym",
+            charcodes + live_len / 2 * sizeof(charcodemap_t)
+            + offsetof(charcodemap_t, symbol));
+  flip_byte("a bad modifier mask",
+            charcodes + (live_len - 1) * sizeof(charcodemap_t)
+            + offsetof(charcodemap_t, modmask));
+  flip_byte("a bad hash table entry", size - sizeof(int));
+
+  /* The file is good, but for the keymap before the change. */
+  original = change_keymap(NULL, &width);
+  read_live_map();
+  expect_rejected("a changed keymap");
+
+  XFree(change_keymap(original, &width));
+  XFree(original);
+  read_live_map();
+  expect_rejected("the keymap changed back");
+
+  unlink(file);
+  free(live);
+  return differences == 0 ? 0 : 1;
+}
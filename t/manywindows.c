@@ -0,0 +1,53 @@
+/* Build with:
+ * gcc -o manywindows manywindows.c -lX11
+ *
+ * Create windows for benchmark.sh to search through. On each screen, COUNT
+ * top-level windows (default 500) named "bench-N" with the class "Bench",
+ * every other one of them mapped, and each with two unnamed children.
+ * Prints "ready" once the server has them all, then waits to be killed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+int main(int argc, char **argv) {
+  Display *dpy = XOpenDisplay(NULL);
+  int count = (argc > 1) ? atoi(argv[1]) : 500;
+  int screen, i, j;
+
+  if (dpy == NULL) {
+    fprintf(stderr, "Unable to open the display\n");
+    return 1;
+  }
+
+  for (screen = 0; screen < ScreenCount(dpy); screen++) {
+    for (i = 0; i < count; i++) {
+      Window window = XCreateSimpleWindow(dpy, RootWindow(dpy, screen),
+                                          0, 0, 10, 10, 0, 0, 0);
+      XClassHint hint;
+      char name[32];
+
+      snprintf(name, sizeof(name), "bench-%d", i);
+      XStoreName(dpy, window, name);
+      hint.res_name = "bench";
+      hint.res_class = "Bench";
+      XSetClassHint(dpy, window, &hint);
+
+      for (j = 0; j < 2; j++)
+        XCreateSimpleWindow(dpy, window, 0, 0, 5, 5, 0, 0, 0);
+      if (i % 2 == 0)
+        XMapWindow(dpy, window);
+    }
+  }
+
+  XSync(dpy, False);
+  printf("ready\n");
+  fflush(stdout);
+
+  pause();
+  XCloseDisplay(dpy);
+  return 0;
+}
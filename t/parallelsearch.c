@@ -0,0 +1,144 @@
+/* Build with:
+ * gcc -I.. parallelsearch.c ../xdo.c ../xdo_index.c ../xdo_select.c -lX11 \
+ *   -lX11-xcb -lxcb -lXtst -lXinerama -lxkbcommon -lpthread -lm
+ *
+ * Usage: parallelsearch NAME
+ *
+ * Needs a server with at least two screens. Creates windows named
+ * NAME-something on each, then searches for them with and without
+ * SEARCH_PARALLEL, with and without a limit and a depth, and prints every
+ * search where the two differ. The same searches are run again with the
+ * connections of some or all of the screens failing to open, which has
+ * those screens searched on the Display's connection instead. Exits 0 if
+ * they always agree, 2 if there is only one screen.
+ */
+
+#include <xcb/xcb.h>
+
+static unsigned int fail_screens;   /* bit n: the nth connection fails */
+static unsigned int connections;
+
+/* Stands in for xcb_connect in xdo_search.c below. */
+static xcb_connection_t *test_xcb_connect(const char *display, int *screen) {
+  if (fail_screens & (1U << connections++))
+    display = ":65535";
+  return xcb_connect(display, screen);
+}
+
+#define xcb_connect test_xcb_connect
+
+/* Yes, I know including .c files is insanity. */
+#include "xdo_search.c"
+
+static void create_windows(Display *dpy, const char *name, int screen) {
+  Window root = RootWindow(dpy, screen);
+  Window parent = None;
+  char title[300];
+  int i;
+
+  /* A few top-level windows, and some children below the first. */
+  for (i = 0; i < 5; i++) {
+    Window window = XCreateSimpleWindow(dpy, i < 3 ? root : parent,
+                                        i * 20, 0, 10, 10, 0, 0, 0);
+
+    snprintf(title, sizeof(title), "%s-%d-%d", name, screen, i);
+    XStoreName(dpy, window, title);
+    XMapWindow(dpy, window);
+    if (i == 0 || i == 3)
+      parent = window;
+  }
+}
+
+static int compare(const xdo_t *xdo, xdo_search_t *search, const char *how) {
+  Window *sequential, *parallel;
+  unsigned int nsequential, nparallel, i;
+  int nscreens = ScreenCount(xdo->xdpy);
+
+  search->searchmask &= ~SEARCH_PARALLEL;
+  xdo_search_windows(xdo, search, &sequential, &nsequential);
+
+  search->searchmask |= SEARCH_PARALLEL;
+  connections = 0;
+  xdo_search_windows(xdo, search, &parallel, &nparallel);
+
+  if (connections != (unsigned int)nscreens) {
+    printf("%s: %u connections opened for %d screens\n", how, connections,
+           nscreens);
+    free(sequential);
+    free(parallel);
+    return 1;
+  }
+
+  if (nsequential == nparallel
+      && memcmp(sequential, parallel, nparallel * sizeof(Window)) == 0) {
+    free(sequential);
+    free(parallel);
+    return 0;
+  }
+
+  printf("%s:\n  without:", how);
+  for (i = 0; i < nsequential; i++)
+    printf(" 0x%lx", sequential[i]);
+  printf("\n  parallel:");
+  for (i = 0; i < nparallel; i++)
+    printf(" 0x%lx", parallel[i]);
+  printf("\n");
+  free(sequential);
+  free(parallel);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  static const unsigned int limits[] = { 0, 1, 2, 4, 7 };
+  static const long depths[] = { -1, 1, 2 };
+  xdo_t *xdo;
+  xdo_search_t search;
+  char pattern[300], how[300];
+  unsigned int l, d, tree, nscreens, differences = 0;
+  int screen;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s NAME\n", argv[0]);
+    return 1;
+  }
+
+  xdo = xdo_new(NULL);
+  if (xdo == NULL) {
+    fprintf(stderr, "Unable to open the display\n");
+    return 1;
+  }
+  nscreens = ScreenCount(xdo->xdpy);
+  if (nscreens < 2) {
+    fprintf(stderr, "Only one screen\n");
+    return 2;
+  }
+
+  for (screen = 0; screen < (int)nscreens; screen++)
+    create_windows(xdo->xdpy, argv[1], screen);
+  XSync(xdo->xdpy, False);
+
+  snprintf(pattern, sizeof(pattern), "^%s-", argv[1]);
+  memset(&search, 0, sizeof(search));
+  search.winname = pattern;
+  search.require = SEARCH_ALL;
+
+  /* Every screen connected, the first or second one failing, and all of
+   * them failing. */
+  for (fail_screens = 0; fail_screens < 4; fail_screens++) {
+    for (tree = 0; tree <= 1; tree++) {
+      for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        for (l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+          search.searchmask = SEARCH_NAME | (tree ? SEARCH_TREE : 0);
+          search.max_depth = depths[d];
+          search.limit = limits[l];
+          snprintf(how, sizeof(how), "failing 0x%x%s, depth %ld, limit %u",
+                   fail_screens, tree ? ", tree" : "", depths[d], limits[l]);
+          differences += compare(xdo, &search, how);
+        }
+      }
+    }
+  }
+
+  xdo_free(xdo);
+  return differences == 0 ? 0 : 1;
+}
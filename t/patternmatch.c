@@ -0,0 +1,176 @@
+/* Build with:
+ * gcc -I.. patternmatch.c ../xdo.c ../xdo_index.c ../xdo_select.c -lX11 \
+ *   -lX11-xcb -lxcb -lXtst -lXinerama -lxkbcommon -lpthread -lm
+ *
+ * Matches every pattern below against every title below both with
+ * _xdo_pattern_match and with regexec(REG_EXTENDED | REG_ICASE), in the
+ * locale from the environment, and prints each pair where the two differ.
+ * Exits 0 if they always agree.
+ *
+ * With --bench FILE, times both ways of matching a few patterns against the
+ * titles in FILE, one per line, instead.
+ */
+
+#include <locale.h>
+#include <time.h>
+
+/* Yes, I know including .c files is insanity. */
+#include "xdo_search.c"
+
+static const char *patterns[] = {
+  "", "^", "$", "^$",
+  "term", "TERM", "^xterm", "xterm$", "^xterm$", "^XTerm$", "x",
+  "firefox", "- Mozilla Firefox$", "^Terminal", "100%", "a b",
+  "\\$", "^\\$$", "a\\$", "a\\\\$", "\\.", "a\\.b", "\\^x", "x\\^",
+  "\\(a\\)", "\\[", "\\\\",
+  "a.b", "(a)", "a|b", "x+", "^x*$", "[xy]term", "\\w", "\\<term",
+  "k", "s", "ss", "i",
+  "caf\xc3\xa9", "^caf\xc3\xa9$", "CAF\xc3\x89",
+  NULL
+};
+
+static const char *titles[] = {
+  "", "x", "X", "xterm", "XTerm", "uxterm", "xterm - bash", "Terminal",
+  "user@host: ~/src", "Mozilla Firefox", "New Tab - Mozilla Firefox",
+  "100% done", "a b", "a  b", "$", "a$", "$a", "a\\", "a\\$", "a.b", "axb",
+  "^x", "x^", "(a)", "a", "[", "]", "\\",
+  "caf\xc3\xa9", "CAF\xc3\x89", "Caf\xc3\xa9 - Notes",
+  "\xe2\x84\xaa",           /* KELVIN SIGN, folds to k */
+  "\xc5\xbf",               /* LATIN SMALL LETTER LONG S, folds to s */
+  "stra\xc3\x9f" "e",       /* sharp s, not "ss" to regexec */
+  "\xc4\xb0stanbul",        /* I WITH DOT ABOVE */
+  "\xc4\xb1",               /* LATIN SMALL LETTER DOTLESS I */
+  "\xff\xfe term",          /* not UTF-8 */
+  "term\xc3",               /* cut off in the middle of a character */
+  NULL
+};
+
+static int regex_match(const char *pattern, const char *title,
+                       int *compiled) {
+  regex_t re;
+  int ret;
+
+  *compiled = (regcomp(&re, pattern, REG_EXTENDED | REG_ICASE) == 0);
+  if (!*compiled)
+    return False;
+  ret = (regexec(&re, title, 0, NULL, 0) == 0);
+  regfree(&re);
+  return ret;
+}
+
+static int check(void) {
+  int i, j, differences = 0;
+
+  for (i = 0; patterns[i] != NULL; i++) {
+    xdo_pattern_t pattern;
+    int compiled, re_compiled;
+
+    compiled = (_xdo_pattern_compile(&pattern, patterns[i]) == 0);
+
+    for (j = 0; titles[j] != NULL; j++) {
+      int want = regex_match(patterns[i], titles[j], &re_compiled);
+      int got;
+
+      if (compiled != re_compiled) {
+        printf("'%s': compiles %d, regcomp %d\n", patterns[i], compiled,
+               re_compiled);
+        differences++;
+        break;
+      }
+      if (!compiled)
+        break;
+
+      got = _xdo_pattern_match(&pattern, titles[j]);
+      if (got != want) {
+        printf("'%s' (%s) on '%s': matched %d, regexec %d\n", patterns[i],
+               pattern.kind == PATTERN_REGEX ? "regex" : "literal",
+               titles[j], got, want);
+        differences++;
+      }
+    }
+
+    if (compiled)
+      _xdo_pattern_free(&pattern);
+  }
+
+  return differences;
+}
+
+static double elapsed_ns(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+/* The kinds of literal pattern people search for. */
+static const char *bench_patterns[] = {
+  "firefox", "^xterm", "- Mozilla Firefox$", "^Terminal$", "zzz", NULL
+};
+
+static int bench(const char *file) {
+  FILE *fp = fopen(file, "r");
+  char **lines = NULL;
+  char buf[4096];
+  int nlines = 0, i, j, round;
+  const int rounds = 2000;
+
+  if (fp == NULL) {
+    perror(file);
+    return 1;
+  }
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    buf[strcspn(buf, "\n")] = '\0';
+    lines = realloc(lines, (nlines + 1) * sizeof(char *));
+    lines[nlines++] = strdup(buf);
+  }
+  fclose(fp);
+
+  printf("%d titles, %d rounds\n", nlines, rounds);
+  for (i = 0; bench_patterns[i] != NULL; i++) {
+    xdo_pattern_t pattern;
+    regex_t re;
+    struct timespec start;
+    double literal_ns, regex_ns;
+    int literal_hits = 0, regex_hits = 0;
+
+    _xdo_pattern_compile(&pattern, bench_patterns[i]);
+    regcomp(&re, bench_patterns[i], REG_EXTENDED | REG_ICASE);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (round = 0; round < rounds; round++)
+      for (j = 0; j < nlines; j++)
+        literal_hits += _xdo_pattern_match(&pattern, lines[j]);
+    literal_ns = elapsed_ns(&start) / ((double)rounds * nlines);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (round = 0; round < rounds; round++)
+      for (j = 0; j < nlines; j++)
+        regex_hits += (regexec(&re, lines[j], 0, NULL, 0) == 0);
+    regex_ns = elapsed_ns(&start) / ((double)rounds * nlines);
+
+    printf("%-22s %7.1f ns  regexec %7.1f ns  (%.1fx, %d matches)\n",
+           bench_patterns[i], literal_ns, regex_ns, regex_ns / literal_ns,
+           literal_hits / rounds);
+    if (literal_hits != regex_hits)
+      printf("  matches differ: %d, regexec %d\n", literal_hits / rounds,
+             regex_hits / rounds);
+
+    _xdo_pattern_free(&pattern);
+    regfree(&re);
+  }
+
+  for (j = 0; j < nlines; j++)
+    free(lines[j]);
+  free(lines);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  setlocale(LC_ALL, "");
+
+  if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+    return bench(argv[2]);
+
+  return check() == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/* Build with:
+ * gcc -o stuckwindow stuckwindow.c -lX11
+ *
+ * Create windows for the --sync tests to time out on. A 200x200 "frame"
+ * holds a 50x50 child named NAME, and the frame redirects its children's
+ * map and configure requests to us. We never grant them, like a window
+ * manager refusing every request, so mapping, moving or resizing NAME from
+ * another client never happens. Also creates a top-level 50x50 window
+ * named NAME-free that nothing holds back, so a window stack can mix both.
+ * Prints "ready" once the server has them, then waits to be killed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+
+int main(int argc, char **argv) {
+  Display *dpy = XOpenDisplay(NULL);
+  const char *name = (argc > 1) ? argv[1] : "stuck";
+  Window root, frame, stuck, free_window;
+  char free_name[256];
+  XEvent event;
+
+  if (dpy == NULL) {
+    fprintf(stderr, "Unable to open the display\n");
+    return 1;
+  }
+
+  root = DefaultRootWindow(dpy);
+  frame = XCreateSimpleWindow(dpy, root, 0, 0, 200, 200, 0, 0, 0);
+  stuck = XCreateSimpleWindow(dpy, frame, 10, 10, 50, 50, 0, 0, 0);
+  free_window = XCreateSimpleWindow(dpy, root, 300, 300, 50, 50, 0, 0, 0);
+
+  snprintf(free_name, sizeof(free_name), "%s-free", name);
+  XStoreName(dpy, stuck, name);
+  XStoreName(dpy, free_window, free_name);
+
+  /* Our own requests aren't redirected, so these still go through. */
+  XSelectInput(dpy, frame, SubstructureRedirectMask);
+  XMapWindow(dpy, stuck);
+  XMapWindow(dpy, frame);
+  XMapWindow(dpy, free_window);
+
+  XSync(dpy, False);
+  printf("ready\n");
+  fflush(stdout);
+
+  /* Swallow the MapRequest and ConfigureRequest events. */
+  for (;;)
+    XNextEvent(dpy, &event);
+
+  XCloseDisplay(dpy);
+  return 0;
+}
@@ -0,0 +1,36 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolCharcodeMapTests < MiniTest::Test
+  include XdoTestHelper
+
+  def setup
+    setup_vars
+    setup_ensure_x_is_healthy
+  end # def setup
+
+  # The xkbcommon-x11 keyboard map has to be the same one Xlib builds.
+  def test_xkbcommon_map_matches_xlib
+    libs = "xkbcommon-x11 xkbcommon x11 x11-xcb xcb xtst xinerama"
+    system("pkg-config --exists #{libs}")
+    skip("xkbcommon-x11 is not installed") if $?.exitstatus != 0
+
+    program = "./charcodemap-#{$$}"
+    status, lines = runcmd("cc -I.. -DHAVE_XKBCOMMON_X11 -o #{program} " \
+                           "charcodemap.c ../xdo_index.c ../xdo_search.c " \
+                           "../xdo_select.c `pkg-config --cflags --libs " \
+                           "#{libs}` -lpthread -lm")
+    assert_status_ok(status, "Building charcodemap.c failed")
+
+    begin
+      status, lines = runcmd(program)
+      skip("xkbcommon-x11 could not read the keymap") if status == 2
+      assert_status_ok(status, "The maps differ:\n#{lines.join("\n")}")
+    ensure
+      File.unlink(program) rescue nil
+    end
+  end # def test_xkbcommon_map_matches_xlib
+end # class XdotoolCharcodeMapTests
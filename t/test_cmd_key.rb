@@ -2,6 +2,7 @@
 #
 
 require "minitest"
+require "open3"
 require "./xdo_test_helper"
 
 class XdotoolCommandKeyTests < MiniTest::Test
@@ -45,5 +46,24 @@ class XdotoolCommandKeyTests < MiniTest::Test
     xdotool_ok "getwindowfocus -f key --window %1 a b c d e"
     xdotool_ok "getwindowfocus -f key --window %@ a b c d e"
   end
+
+  def test_repeat_with_more_keysyms_than_spare_keycodes
+    status, before = runcmd("xmodmap -pke")
+    spare = before.grep(/^keycode +[0-9]+ =\s*$/).length
+
+    # Characters no key types, one more than there are keycodes to bind
+    # them to, so the bindings have to be reused within each repetition.
+    keysyms = (0 .. spare).collect { |i| "U%X" % (0x4e00 + i) }
+
+    xdotool_ok "windowfocus --sync #{@wid}"
+    out, err, status = Open3.capture3(@xdotool, "key", "--repeat", "3",
+                                      *keysyms)
+    assert_equal(0, status.exitstatus, "key --repeat should exit zero")
+    assert_equal([], err.lines.grep(/skipping/),
+                 "Every key should have been given a keycode")
+
+    status, after = runcmd("xmodmap -pke")
+    assert_equal(before, after, "The spare keycodes should be unbound again")
+  end # def test_repeat_with_more_keysyms_than_spare_keycodes
 end # class XdotoolCommandKeyTests
 
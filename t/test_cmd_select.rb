@@ -0,0 +1,28 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolCommandSelectTests < MiniTest::Test
+  include XdoTestHelper
+
+  # --clients asks for _NET_CLIENT_LIST, so it is read even when
+  # _NET_SUPPORTED doesn't list it (or, as here, there is no
+  # _NET_SUPPORTED at all).
+  def test_clients_without_net_supported
+    if detect_window_manager != :none
+      skip("The window manager owns _NET_CLIENT_LIST")
+    end
+
+    system("xprop -root -f _NET_CLIENT_LIST 32c " \
+           "-set _NET_CLIENT_LIST #{@wid}")
+    begin
+      status, lines = xdotool "select --clients --title '^#{@title}$'"
+      assert_status_ok(status, "select --clients should find the window")
+      assert_equal([@wid], lines.collect { |l| l.to_i(16) })
+    ensure
+      system("xprop -root -remove _NET_CLIENT_LIST")
+    end
+  end # def test_clients_without_net_supported
+end # class XdotoolCommandSelectTests
@@ -3,6 +3,7 @@
 #
 
 require "minitest"
+require "open3"
 require "./xdo_test_helper"
 
 class XdotoolCommandWindowMapTests < MiniTest::Test
@@ -25,4 +26,16 @@ class XdotoolCommandWindowMapTests < MiniTest::Test
     xdotool_ok "getwindowfocus -f windowmap %1"
     xdotool_ok "getwindowfocus -f windowmap %@"
   end # def test_chaining
+
+  # This waits out the whole 15 seconds --sync gives the window.
+  def test_sync_fails_when_the_window_is_not_mapped
+    setup_stuck_window
+    xdotool_ok "search --name '^#{@stuck}$' windowunmap --sync %1"
+
+    out, err, status = Open3.capture3(@xdotool, "search", "--name",
+                                      "^#{@stuck}$", "windowmap", "--sync",
+                                      "%1")
+    assert_status_fail(status.exitstatus, "windowmap --sync should time out")
+    assert_match(/windowmap: window [0-9]+ was not mapped in time/, err)
+  end # def test_sync_fails_when_the_window_is_not_mapped
 end # class XdotoolCommandWindowMapTests
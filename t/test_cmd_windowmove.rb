@@ -3,6 +3,7 @@
 #
 
 require "minitest"
+require "open3"
 require "./xdo_test_helper"
 
 class XdotoolCommandWindowMoveTests < MiniTest::Test
@@ -26,5 +27,36 @@ class XdotoolCommandWindowMoveTests < MiniTest::Test
     xdotool_ok "getwindowfocus -f windowmove %1 20 20"
     xdotool_ok "getwindowfocus -f windowmove %@ 20 20"
   end # def test_chaining
+
+  # Only x changes much here, which --sync used to not wait for at all.
+  def test_sync_fails_when_the_window_does_not_move
+    setup_stuck_window
+    out, err, status = Open3.capture3(@xdotool, "search", "--name",
+                                      "^#{@stuck}$", "windowmove", "--sync",
+                                      "--timeout", "500", "%1", "600", "10")
+    assert_status_fail(status.exitstatus, "windowmove --sync should time out")
+    assert_match(/windowmove: window [0-9]+ did not move/, err)
+  end # def test_sync_fails_when_the_window_does_not_move
+
+  def test_sync_failure_still_moves_the_rest_of_the_stack
+    setup_stuck_window
+    geometry = "search --name '^#{@stuck}-free$' getwindowgeometry --shell"
+    status, before = xdotool geometry
+    assert_status_ok(status)
+
+    status, lines = xdotool "search --name '^#{@stuck}(-free)?$' " \
+                            "windowmove --sync --timeout 500 %@ 600 10"
+    assert_status_fail(status, "windowmove --sync should time out")
+
+    status, after = xdotool geometry
+    assert_status_ok(status)
+    refute_equal(before.grep(/^X=/), after.grep(/^X=/),
+                 "The free window should be moved")
+  end # def test_sync_failure_still_moves_the_rest_of_the_stack
+
+  def test_timeout_must_be_a_number
+    xdotool_fail "windowmove --sync --timeout abc #{@wid} 20 20"
+    xdotool_fail "windowmove --sync --timeout 99999999999 #{@wid} 20 20"
+  end # def test_timeout_must_be_a_number
 end # class XdotoolCommandWindowMoveTests
 
@@ -3,6 +3,7 @@
 #
 
 require "minitest"
+require "open3"
 require "./xdo_test_helper"
 
 class XdotoolCommandWindowSizeTests < MiniTest::Test
@@ -30,5 +31,32 @@ class XdotoolCommandWindowSizeTests < MiniTest::Test
     xdotool_ok "getwindowfocus -f windowsize %1 20 20"
     xdotool_ok "getwindowfocus -f windowsize %@ 20 20"
   end # def test_chaining
+
+  def test_sync_fails_when_the_size_does_not_change
+    setup_stuck_window
+    out, err, status = Open3.capture3(@xdotool, "search", "--name",
+                                      "^#{@stuck}$", "windowsize", "--sync",
+                                      "--timeout", "500", "%1", "80", "80")
+    assert_status_fail(status.exitstatus, "windowsize --sync should time out")
+    assert_match(/windowsize: window [0-9]+ is 50x50 \(asked for 80x80\)/, err)
+  end # def test_sync_fails_when_the_size_does_not_change
+
+  def test_sync_failure_still_resizes_the_rest_of_the_stack
+    setup_stuck_window
+    status, lines = xdotool "search --name '^#{@stuck}(-free)?$' " \
+                            "windowsize --sync --timeout 500 %@ 80 80"
+    assert_status_fail(status, "windowsize --sync should time out")
+
+    status, lines = xdotool "search --name '^#{@stuck}-free$' " \
+                            "getwindowgeometry --shell"
+    assert_status_ok(status)
+    assert_includes(lines, "WIDTH=80", "The free window should be resized")
+    assert_includes(lines, "HEIGHT=80", "The free window should be resized")
+  end # def test_sync_failure_still_resizes_the_rest_of_the_stack
+
+  def test_timeout_must_be_a_number
+    xdotool_fail "windowsize --sync --timeout abc #{@wid} 20 20"
+    xdotool_fail "windowsize --sync --timeout -1 #{@wid} 20 20"
+  end # def test_timeout_must_be_a_number
 end # class XdotoolCommandWindowsizeTests
 
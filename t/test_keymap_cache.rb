@@ -0,0 +1,35 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolKeymapCacheTests < MiniTest::Test
+  include XdoTestHelper
+
+  def setup
+    setup_vars
+    setup_ensure_x_is_healthy
+  end # def setup
+
+  # A keymap cache file that is damaged, or was made for another keymap,
+  # must never be used; the keymap has to be read from the server instead.
+  def test_bad_cache_files_are_not_used
+    libs = "x11 x11-xcb xcb xtst xinerama xkbcommon"
+    program = "./keymapcache-#{$$}"
+    file = "/tmp/xdo-keymap-test-#{$$}"
+    status, lines = runcmd("cc -I.. -o #{program} keymapcache.c " \
+                           "../xdo_index.c ../xdo_search.c ../xdo_select.c " \
+                           "`pkg-config --cflags --libs #{libs}` " \
+                           "-lpthread -lm")
+    assert_status_ok(status, "Building keymapcache.c failed")
+
+    begin
+      status, lines = runcmd("#{program} #{file}")
+      assert_status_ok(status, "Bad cache files:\n#{lines.join("\n")}")
+    ensure
+      File.unlink(program) rescue nil
+      File.unlink(file) rescue nil
+    end
+  end # def test_bad_cache_files_are_not_used
+end # class XdotoolKeymapCacheTests
@@ -0,0 +1,43 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolParallelSearchTests < MiniTest::Test
+  include XdoTestHelper
+
+  def setup
+    setup_vars
+    setup_ensure_x_is_healthy
+  end # def setup
+
+  # Searching the screens in parallel has to find the same windows, in the
+  # same order, as searching them one after the other; and so does falling
+  # back to the Display's connection when a screen's connection fails.
+  def test_parallel_search_matches_sequential
+    libs = "x11 x11-xcb xcb xtst xinerama xkbcommon"
+    program = "./parallelsearch-#{$$}"
+    status, lines = runcmd("cc -I.. -o #{program} parallelsearch.c " \
+                           "../xdo.c ../xdo_index.c ../xdo_select.c " \
+                           "`pkg-config --cflags --libs #{libs}` " \
+                           "-lpthread -lm")
+    assert_status_ok(status, "Building parallelsearch.c failed")
+
+    begin
+      status, lines = runcmd("#{program} parallel#{$$}")
+
+      # Our server has one screen; start one with two, if we can.
+      if status == 2
+        system("which Xvfb > /dev/null 2>&1")
+        skip("The X server has one screen, and there is no Xvfb") if $? != 0
+        status, lines = runcmd("sh ephemeral-x.sh -q -x 'Xvfb -ac " \
+                               "-screen 0 640x480x24 -screen 1 640x480x24' " \
+                               "#{program} parallel#{$$}")
+      end
+      assert_status_ok(status, "The searches differ:\n#{lines.join("\n")}")
+    ensure
+      File.unlink(program) rescue nil
+    end
+  end # def test_parallel_search_matches_sequential
+end # class XdotoolParallelSearchTests
@@ -0,0 +1,36 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolPatternMatchTests < MiniTest::Test
+  include XdoTestHelper
+
+  def setup
+    setup_vars
+  end # def setup
+
+  # Plain-text search patterns skip regexec; they have to match exactly the
+  # titles regexec would, in a single-byte locale and in UTF-8.
+  def test_literal_patterns_match_like_regexec
+    libs = "x11 x11-xcb xcb xtst xinerama xkbcommon"
+    program = "./patternmatch-#{$$}"
+    status, lines = runcmd("cc -I.. -o #{program} patternmatch.c ../xdo.c " \
+                           "../xdo_index.c ../xdo_select.c `pkg-config " \
+                           "--cflags --libs #{libs}` -lpthread -lm")
+    assert_status_ok(status, "Building patternmatch.c failed")
+
+    status, utf8 = runcmd("locale -a")
+    locales = ["C"] + utf8.grep(/^(C|en_US)\.utf-?8$/i).first(1)
+
+    begin
+      locales.each do |locale|
+        status, lines = runcmd("LC_ALL=#{locale} #{program}")
+        assert_status_ok(status, "In #{locale}:\n#{lines.join("\n")}")
+      end
+    ensure
+      File.unlink(program) rescue nil
+    end
+  end # def test_literal_patterns_match_like_regexec
+end # class XdotoolPatternMatchTests
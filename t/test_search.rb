@@ -2,6 +2,7 @@
 #
 
 require "minitest"
+require "timeout"
 require "./xdo_test_helper"
 
 class XdotoolSearchTests < MiniTest::Test
@@ -152,4 +153,122 @@ class XdotoolSearchTests < MiniTest::Test
                    "Expected same window list from xwininfo and xdotool")
     end # ["name" ... ].each
   end # def test_search_can_find_all_windows
+
+  def test_search_limit_stops_at_the_first_results
+    status, all = xdotool "search --name '^'"
+    assert_equal(0, status, "Search for every window should exit zero")
+    assert_operator(all.length, :>, 2,
+                    "Expected more than 2 windows for --limit to cut off")
+
+    # Results are printed as they are found, in the same order with or
+    # without a limit, so a limited search is the start of a full one.
+    [1, 2].each do |limit|
+      status, lines = xdotool "search --limit #{limit} --name '^'"
+      assert_equal(0, status, "Search with --limit #{limit} should exit zero")
+      assert_equal(all.first(limit), lines,
+                   "Search with --limit #{limit} should print the first " \
+                   "#{limit} results of the same search without a limit")
+    end
+  end # def test_search_limit_stops_at_the_first_results
+
+  def test_search_stacking
+    status, lines = xdotool "search --stacking --name '^'"
+    assert_equal(0, status, "Search with --stacking should exit zero")
+    found = lines.collect { |w| w.to_i(16) }
+
+    status, lines = xdotool "search --name '^'"
+    assert_equal(found.sort, lines.collect { |w| w.to_i(16) }.sort,
+                 "--stacking should find the same windows, in another order")
+
+    if wm_supports?("_NET_CLIENT_LIST_STACKING")
+      status, lines = runcmd("xprop -root _NET_CLIENT_LIST_STACKING")
+      stacking = lines.first.scan(/0x[0-9A-Fa-f]+/).collect { |w| w.to_i(16) }
+      assert_equal(stacking & found, found & stacking,
+                   "Windows should come out in _NET_CLIENT_LIST_STACKING order")
+    end
+  end # def test_search_stacking
+
+  def test_search_client_list_and_tree_walk_agree
+    # Without --tree, a search with no --maxdepth only looks at the
+    # window manager's client list if it has one.
+    status, listed = xdotool "search --name '#{@title}'"
+    assert_equal(0, status, "Search for our window should exit zero")
+    status, walked = xdotool "search --tree --name '#{@title}'"
+    assert_equal(0, status, "Search with --tree for our window should exit zero")
+    assert_equal([@wid], listed.collect { |w| w.to_i(16) },
+                 "Search should find our window")
+    assert_equal([@wid], walked.collect { |w| w.to_i(16) },
+                 "Search with --tree should find our window")
+
+    status, listed = xdotool "search --name '^'"
+    status, walked = xdotool "search --tree --name '^'"
+    listed = listed.collect { |w| w.to_i(16) }
+    walked = walked.collect { |w| w.to_i(16) }
+    if wm_supports?("_NET_CLIENT_LIST")
+      assert_equal([], listed - walked,
+                   "Every window from the client list should be in the tree")
+    else
+      assert_equal(walked, listed,
+                   "Without a client list both searches walk the tree")
+    end
+  end # def test_search_client_list_and_tree_walk_agree
+
+  def test_search_sync_wakes_when_a_window_appears
+    name = "sync#{rand}"
+    search = IO.popen([@xdotool, "search", "--sync", "--name", name],
+                      :err => "/dev/null")
+
+    # Let the search start waiting before the window is there.
+    sleep 0.5
+    setup_launch("xterm", "-T", name, "-e", "sleep 300")
+
+    found = nil
+    Timeout.timeout(10) do
+      found = search.readlines.collect { |w| w.chomp }
+    end
+    search.close
+    assert_equal(0, $?.exitstatus, "search --sync should exit zero")
+
+    status, lines = xdotool "search --name '#{name}'"
+    assert_equal(0, status, "Search for the new window should exit zero")
+    assert_equal(lines.sort, found.sort,
+                 "search --sync should print the window once it appears")
+  end # def test_search_sync_wakes_when_a_window_appears
+
+  # Windows that can't match don't start the search again, and --shell
+  # prints one array, not one for every try.
+  def test_search_sync_only_tries_again_for_windows_that_could_match
+    name = "sync#{rand}"
+    stderr_r, stderr_w = IO.pipe
+    search = IO.popen([{ "DEBUG" => "1" }, @xdotool, "search", "--sync",
+                       "--shell", "--name", name], :err => stderr_w)
+    stderr_w.close
+
+    # Let the search start waiting, then give it windows to look at that
+    # don't match.
+    sleep 0.5
+    setup_launch("xterm", "-T", "other#{rand}", "-e", "sleep 300")
+    other = @launchpid
+    begin
+      sleep 0.5
+      setup_launch("xterm", "-T", name, "-e", "sleep 300")
+
+      output = nil
+      Timeout.timeout(10) do
+        output = search.readlines.collect { |l| l.chomp }
+      end
+      search.close
+    ensure
+      Process.kill("TERM", other) rescue nil
+      Process.wait(other) rescue nil
+    end
+    assert_equal(0, $?.exitstatus, "search --sync should exit zero")
+
+    waits = stderr_r.readlines.grep(/still waiting/)
+    stderr_r.close
+    assert_equal(1, waits.length,
+                 "search --sync should only search again for the new window")
+    assert_equal(1, output.grep(/^WINDOWS=\(/).length,
+                 "search --sync --shell should print one array: #{output}")
+  end # def test_search_sync_only_tries_again_for_windows_that_could_match
 end # XdotoolSearchTests
@@ -140,5 +140,51 @@ class XdotoolTypingTests < MiniTest::Test
     assert_equal(input.join(""), data)
   end # def test_terminator
 
+  def test_file_with_character_across_read_boundary
+    # type --file reads 4096 bytes at a time. Put a two byte character
+    # across the first boundary. The lines are kept short for the tty.
+    input = ("a" * 63 + "\n") * 63 + "a" * 63 + "\u00e9bc"
+    assert_equal("a", input.byteslice(4094), "The test input is misaligned")
+
+    source = Tempfile.new("xdotool-test-input")
+    source.write(input)
+    source.close
+
+    status, lines = xdotool "type --delay 0 --file #{source.path}"
+    assert_equal(0, status,
+                 "type --file should not see an invalid multibyte sequence")
+    xdotool "key ctrl+d ctrl+d"
+    Process.wait(@launchpid) rescue nil
+
+    # The terminal writes the character in its own locale's encoding.
+    data = File.binread(@file.path).chomp
+    typed = data.dup.force_encoding("UTF-8")
+    if !typed.valid_encoding?
+      typed = data.dup.force_encoding("ISO-8859-1").encode("UTF-8")
+    end
+    assert_equal(input, typed)
+  ensure
+    source.unlink if source
+  end # def test_file_with_character_across_read_boundary
+
+  def test_key_window_follows_focus
+    other = "other#{rand}"
+    setup_launch("xterm", "-T", other, "-e", "sleep 300")
+    status, lines = xdotool "search --sync --name '#{other}'"
+    other_wid = lines.first.to_i(16)
+
+    # All in one process, so the focus it keeps track of has to follow each
+    # change. Keys for a window without focus go out with XSendEvent,
+    # which xterm ignores, so the 'x' must not arrive.
+    xdotool "windowfocus --sync #{@wid} key --window #{@wid} h " \
+            "windowfocus --sync #{other_wid} key --window #{@wid} x " \
+            "windowfocus --sync #{@wid} key --window #{@wid} i"
+    xdotool "key ctrl+d ctrl+d"
+
+    try do
+      assert_equal("hi", readfile)
+    end
+  end # def test_key_window_follows_focus
+
 end # class XdotoolTypingTests
 
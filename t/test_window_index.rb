@@ -0,0 +1,34 @@
+#!/usr/bin/env ruby
+#
+
+require "minitest"
+require "./xdo_test_helper"
+
+class XdotoolWindowIndexTests < MiniTest::Test
+  include XdoTestHelper
+
+  def setup
+    setup_vars
+    setup_ensure_x_is_healthy
+  end # def setup
+
+  # Searches answered from the window index have to find what searching
+  # the server finds, after windows are mapped, unmapped, restacked,
+  # reparented, renamed, created and destroyed.
+  def test_index_follows_window_changes
+    libs = "x11 x11-xcb xcb xtst xinerama xkbcommon"
+    program = "./windowindex-#{$$}"
+    status, lines = runcmd("cc -I.. -o #{program} windowindex.c ../xdo.c " \
+                           "../xdo_index.c ../xdo_search.c ../xdo_select.c " \
+                           "`pkg-config --cflags --libs #{libs}` " \
+                           "-lpthread -lm")
+    assert_status_ok(status, "Building windowindex.c failed")
+
+    begin
+      status, lines = runcmd("#{program} windowindex#{$$}")
+      assert_status_ok(status, "Index differences:\n#{lines.join("\n")}")
+    ensure
+      File.unlink(program) rescue nil
+    end
+  end # def test_index_follows_window_changes
+end # class XdotoolWindowIndexTests
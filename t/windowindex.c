@@ -0,0 +1,212 @@
+/* Build with:
+ * gcc -I.. windowindex.c ../xdo.c ../xdo_index.c ../xdo_search.c \
+ *   ../xdo_select.c -lX11 -lX11-xcb -lxcb -lXtst -lXinerama -lxkbcommon \
+ *   -lpthread -lm
+ *
+ * Usage: windowindex NAME
+ *
+ * Creates windows named NAME-something from another client, then maps,
+ * unmaps, restacks, reparents, renames, creates and destroys them. After
+ * each change, checks that a search answered from the window index (see
+ * xdo_enable_window_index) finds the same windows, in the same order, as
+ * one that asks the server. Also checks that property changes the index
+ * has no use for are left in the queue. Prints what went wrong and exits 1
+ * if anything did.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include "xdo.h"
+
+static xdo_t *xdo;        /* with the index */
+static xdo_t *plain;      /* without, asks the server every time */
+static Display *other;    /* makes the changes, like any other client */
+static char pattern[256];
+static int differences;
+
+static void search(const xdo_t *x, int only_visible, Window **windows,
+                   unsigned int *nwindows) {
+  xdo_search_t search;
+
+  memset(&search, 0, sizeof(search));
+  search.winname = pattern;
+  search.searchmask = SEARCH_NAME;
+  search.max_depth = -1;
+  search.only_visible = only_visible;
+  search.require = SEARCH_ALL;
+  xdo_search_windows(x, &search, windows, nwindows);
+}
+
+static void print_windows(const char *who, const Window *windows,
+                          unsigned int nwindows) {
+  unsigned int i;
+
+  printf("  %s:", who);
+  for (i = 0; i < nwindows; i++)
+    printf(" 0x%lx", windows[i]);
+  printf("\n");
+}
+
+/* Let the index catch up with what the other client did, then compare. */
+static void check(const char *what) {
+  int only_visible;
+
+  XSync(other, False);
+  XSync(xdo->xdpy, False);
+  xdo_window_index_update(xdo);
+
+  for (only_visible = 0; only_visible <= 1; only_visible++) {
+    Window *indexed, *server;
+    unsigned int nindexed, nserver;
+
+    search(xdo, only_visible, &indexed, &nindexed);
+    search(plain, only_visible, &server, &nserver);
+    if (nindexed != nserver
+        || memcmp(indexed, server, nserver * sizeof(Window)) != 0) {
+      printf("%s%s: the index is out of date\n", what,
+             only_visible ? " (visible windows)" : "");
+      print_windows("index", indexed, nindexed);
+      print_windows("server", server, nserver);
+      differences++;
+    }
+    free(indexed);
+    free(server);
+  }
+}
+
+/* Override redirect, so that a window manager leaves them alone. */
+static Window create(Window parent, const char *suffix, int x) {
+  XSetWindowAttributes attrs;
+  char name[300];
+  Window window;
+
+  attrs.override_redirect = True;
+  window = XCreateWindow(other, parent, x, 0, 50, 50, 0, CopyFromParent,
+                         InputOutput, CopyFromParent, CWOverrideRedirect,
+                         &attrs);
+  snprintf(name, sizeof(name), "%s-%s", pattern + 1, suffix);
+  XStoreName(other, window, name);
+  return window;
+}
+
+/* How many changes to the given root property are waiting in the queue. */
+static int queued_changes(Window root, Atom atom) {
+  XEvent events[64];
+  int i, n = 0, count = 0;
+
+  while (n < 64 && XCheckTypedWindowEvent(xdo->xdpy, root, PropertyNotify,
+                                          &events[n]))
+    n++;
+  for (i = 0; i < n; i++) {
+    if (events[i].xproperty.atom == atom)
+      count++;
+  }
+  /* Put them back, in the same order. */
+  for (i = n - 1; i >= 0; i--)
+    XPutBackEvent(xdo->xdpy, &events[i]);
+  return count;
+}
+
+int main(int argc, char **argv) {
+  Window root, a, b, frame, child1, child2, later;
+  Atom atom;
+  char name[300];
+  long value = 1;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s NAME\n", argv[0]);
+    return 2;
+  }
+  snprintf(pattern, sizeof(pattern), "^%s-", argv[1]);
+
+  xdo = xdo_new(NULL);
+  plain = xdo_new(NULL);
+  other = XOpenDisplay(NULL);
+  if (xdo == NULL || plain == NULL || other == NULL) {
+    fprintf(stderr, "Unable to open the display\n");
+    return 2;
+  }
+  root = DefaultRootWindow(other);
+
+  a = create(root, "a", 0);
+  b = create(root, "b", 60);
+  frame = create(root, "frame", 120);
+  child1 = create(frame, "child1", 0);
+  child2 = create(frame, "child2", 10);
+  XSync(other, False);
+
+  /* Root property changes are ours too, not only the index's. */
+  XSelectInput(xdo->xdpy, root, PropertyChangeMask);
+  xdo_enable_window_index(xdo);
+  check("created, unmapped");
+
+  XMapWindow(other, a);
+  XMapWindow(other, b);
+  XMapWindow(other, child1);
+  XMapWindow(other, child2);
+  check("mapped, in an unmapped frame");
+
+  XMapWindow(other, frame);
+  check("frame mapped");
+
+  XUnmapWindow(other, b);
+  check("unmapped");
+  XMapWindow(other, b);
+  check("mapped again");
+
+  XRaiseWindow(other, a);
+  check("raised");
+  XLowerWindow(other, a);
+  check("lowered");
+  XCirculateSubwindowsUp(other, frame);
+  check("circulated");
+
+  XReparentWindow(other, b, frame, 20, 20);
+  check("reparented into the frame");
+  XReparentWindow(other, b, root, 60, 0);
+  check("reparented back");
+
+  XStoreName(other, a, "renamed");
+  check("renamed away");
+  snprintf(name, sizeof(name), "%s-a", pattern + 1);
+  XStoreName(other, a, name);
+  check("renamed back");
+
+  later = create(root, "later", 180);
+  XMapWindow(other, later);
+  check("created later");
+
+  XDestroyWindow(other, b);
+  check("destroyed");
+  XDestroyWindow(other, frame);
+  check("destroyed with children");
+
+  /* A new property changes the root's property list, and a new value for
+   * it changes nothing the index keeps, so that one stays queued. */
+  snprintf(name, sizeof(name), "%s_TEST", argv[1]);
+  atom = XInternAtom(other, name, False);
+  XChangeProperty(other, root, atom, XA_CARDINAL, 32, PropModeReplace,
+                  (unsigned char *)&value, 1);
+  XChangeProperty(other, root, atom, XA_CARDINAL, 32, PropModeReplace,
+                  (unsigned char *)&value, 1);
+  check("root property changed");
+  if (queued_changes(root, atom) != 1) {
+    printf("root property changed: %d events left in the queue, wanted 1\n",
+           queued_changes(root, atom));
+    differences++;
+  }
+  XDeleteProperty(other, root, atom);
+  check("root property deleted");
+
+  XDestroyWindow(other, a);
+  XDestroyWindow(other, later);
+  XSync(other, False);
+  XCloseDisplay(other);
+  xdo_free(plain);
+  xdo_free(xdo);
+  return differences == 0 ? 0 : 1;
+}
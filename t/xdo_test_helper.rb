@@ -42,6 +42,23 @@ module XdoTestHelper
     end
   end # def setup_launch_xterm
 
+  # Start stuckwindow.c. The window named @stuck never gets mapped, moved
+  # or resized when we ask, so --sync has to time out on it. The window
+  # named "#{@stuck}-free" behaves.
+  def setup_stuck_window
+    program = "./stuckwindow-#{$$}"
+    if !File.exist?(program)
+      status, lines = runcmd("cc -o #{program} stuckwindow.c " \
+                             "`pkg-config --cflags --libs x11`")
+      assert_status_ok(status, "Building stuckwindow.c failed")
+      at_exit { File.unlink(program) rescue nil }
+    end
+
+    @stuck = "stuck-#{rand(1 << 30)}"
+    @stuckio = IO.popen([program, @stuck])
+    assert_equal("ready\n", @stuckio.gets, "stuckwindow did not start")
+  end # def setup_stuck_window
+
   def setup_ensure_x_is_healthy
     healthy = false
     (1 .. 10).each do
@@ -75,6 +92,11 @@ module XdoTestHelper
       Process.kill("TERM", @launchpid) rescue nil
       Process.wait(@launchpid) rescue nil
     end
+
+    if @stuckio
+      Process.kill("TERM", @stuckio.pid) rescue nil
+      @stuckio.close rescue nil
+    end
   end # def teardown
 
   def xdotool(args)
@@ -11,14 +11,18 @@
 #endif /* _XOPEN_SOURCE */
 
 #include <sys/select.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
 #include <regex.h>
 #include <ctype.h>
-#include <locale.h>
 #include <stdarg.h>
 
 #include <X11/Xlib.h>
@@ -31,23 +35,229 @@
 #include <X11/keysym.h>
 #include <X11/cursorfont.h>
 
+#include <X11/Xlib-xcb.h>
+
 #include <xkbcommon/xkbcommon.h>
+#ifdef HAVE_XKBCOMMON_X11
+#include <xkbcommon/xkbcommon-x11.h>
+#endif
 
 #include "xdo.h"
+#include "xdo_search.h"
 #include "xdo_util.h"
 #include "xdo_version.h"
 
 #define DEFAULT_DELAY 12
 
 /**
- * The number of tries to check for a wait condition before aborting.
- * TODO(sissel): Make this tunable at runtime?
+ * How long the xdo_wait_for_* functions wait by default, in milliseconds.
+ * This is what 500 checks 30ms apart used to add up to.
  */
-#define MAX_TRIES 500
+#define DEFAULT_WAIT_TIMEOUT 15000
+
+/* What a wait is waiting for; which fields matter depends on the wait. */
+typedef struct wait_condition {
+  Window window;
+  int want;                     /* map state, focus wanted, SIZE_TO, ... */
+  int x, y;
+  unsigned int width, height;
+} wait_condition_t;
+
+/* Returns 1 once the condition holds, 0 if it doesn't yet, or -1 if it
+ * can't be checked. */
+typedef int (*wait_check_t)(const xdo_t *xdo, const wait_condition_t *cond);
+
+/* Characters and keysyms below this are looked up in a plain array. The
+ * Latin-1 keysyms have the same values as their characters. */
+#define CHARCODE_LATIN_SIZE 0x100
+
+/* Where to find things in xdo->charcodes without scanning all of it.
+ *
+ * Every table holds the index of the first charcodes entry for a character
+ * or keysym, or -1 for none, so lookups give the same entry a scan from the
+ * start would. Anything outside the Latin range goes in an open addressing
+ * hash table, probed linearly. */
+struct xdo_charcode_index {
+  int latin_chars[CHARCODE_LATIN_SIZE];
+  int latin_keysyms[CHARCODE_LATIN_SIZE];
+
+  int *chars;
+  int *keysyms;
+  unsigned int mask;    /* hash table size - 1 */
+
+  /* chars and keysyms point into the keymap cache file, see below. */
+  int mapped;
+};
+
+/* The file xdo_enable_keymap_cache keeps the charcode map in: this header,
+ * then the charcodes, then the chars and keysyms hash tables. It is only
+ * ever read back on the same machine (it lives in $XDG_RUNTIME_DIR by
+ * default), so everything is stored as it is in memory, and the file is
+ * used as it is, mapped read-only.
+ *
+ * The fingerprint is a hash of the server's core keyboard and modifier
+ * mappings, which are checked again each time before the file is used.
+ * The checksum is a hash of the latin tables and everything after the
+ * header, since a keycode gone bad in the file would otherwise pass for a
+ * good one and type the wrong key. */
+#define KEYMAP_CACHE_MAGIC "xdokmap"
+#define KEYMAP_CACHE_VERSION 2
+
+struct keymap_cache_header {
+  char magic[8];
+  unsigned int version;
+  unsigned int charcode_size;   /* sizeof(charcodemap_t) */
+  uint64_t fingerprint;
+  uint64_t checksum;
+  int keysyms_per_keycode;
+  int charcodes_len;
+  unsigned int mask;
+  int latin_chars[CHARCODE_LATIN_SIZE];
+  int latin_keysyms[CHARCODE_LATIN_SIZE];
+};
+
+/* Where the charcodes start, past the header and suitably aligned. */
+#define KEYMAP_CACHE_CHARCODES \
+  ((sizeof(struct keymap_cache_header) + 15) & ~(size_t)15)
+
+/* What sending keys needs to know about the keyboard, read from the server
+ * once and only again after the mapping changes (see
+ * _xdo_check_mapping_notify).
+ *
+ * The keycodes with no keysyms on them are borrowed to type keysyms that
+ * aren't on the keyboard. Bindings are kept while text is being typed, so a
+ * character that comes up again reuses its keycode, and the least recently
+ * used keycode is the one rebound. */
+struct xdo_keymap_cache {
+  /* A keycode for each of the 8 modifiers (0 if none), to press them. */
+  KeyCode modifiers[8];
+  int modifiers_valid;
+
+  int valid;
+  int *keycodes;        /* in increasing order */
+  int nkeycodes;
+
+  KeySym *bound;        /* what each keycode is bound to, or NoSymbol */
+  int *dirty;           /* binding not sent to the server yet */
+  unsigned long *last_used;
+  unsigned long clock;
+
+  /* Bindings are undone once the last hold is released. */
+  int holds;
+
+  /* How many MappingNotify events our own XChangeKeyboardMapping calls on
+   * free keycodes have yet to produce. Those don't make the list stale. */
+  int own_changes;
+
+  /* Whether keys for focus_window go through XTest. Remembered while the
+   * bindings are held, or until a FocusIn or FocusOut if tracking. */
+  Window focus_window;
+  int focus_xtest;
+  int focus_valid;
+
+  /* See xdo_enable_focus_tracking. When tracking, focus_window is the
+   * window listened to, and focus_listening is None unless we were the ones
+   * to select FocusChangeMask on it. */
+  int focus_tracking;
+  Window focus_listening;
+
+  /* The keyboard group XTest keys were last sent in, and the one to put
+   * back. Read from the server the first time a key goes through XTest,
+   * kept while the keycode bindings are held, and put back with them. */
+  int group_valid;
+  int group;
+  int original_group;
+
+  /* See xdo_enable_keymap_cache. If the charcode map came from the file,
+   * xdo->charcodes and the index tables point into mapped. */
+  char *file;
+  void *mapped;
+  size_t mapped_size;
+};
 
+/* One key press or release of text compiled by xdo_key_buffer_add_text. */
+struct xdo_key_event {
+  KeySym symbol;          /* to bind to a spare keycode if code is 0 */
+  KeyCode code;
+  unsigned char group;
+  unsigned char modmask;
+  unsigned char pressed;
+  useconds_t delay;       /* how long to sleep after sending it */
+};
+
+struct xdo_key_buffer {
+  const xdo_t *xdo;
+  useconds_t delay;
+  struct xdo_key_event *events;
+  int nevents;
+  int size;
+
+  /* The start of a UTF-8 character xdo_key_buffer_add_bytes was given
+   * only part of. */
+  unsigned char partial[4];
+  int npartial;
+};
+
+struct xdo_keysequence {
+  const xdo_t *xdo;
+  charcodemap_t *keys;
+  int nkeys;
+};
+
+static void _xdo_need_charcode_map(const xdo_t *xdo);
 static void _xdo_populate_charcode_map(xdo_t *xdo);
+static void _xdo_populate_charcode_map_xlib(xdo_t *xdo);
+static void _xdo_free_charcode_map(xdo_t *xdo);
+static uint64_t _xdo_fnv1a(uint64_t hash, const void *data, size_t size);
+static uint64_t _xdo_keymap_fingerprint(const xdo_t *xdo);
+static int _xdo_load_keymap_cache(xdo_t *xdo, uint64_t fingerprint);
+static int _xdo_check_keymap_cache(const unsigned char *map, size_t size);
+static uint64_t _xdo_keymap_cache_checksum(
+    const struct keymap_cache_header *header, const void *data, size_t size);
+static void _xdo_save_keymap_cache(const xdo_t *xdo, uint64_t fingerprint);
+#ifdef HAVE_XKBCOMMON_X11
+static int _xdo_populate_charcode_map_xkbcommon(xdo_t *xdo);
+#endif
+static void _xdo_index_charcode_map(xdo_t *xdo);
+static void _xdo_free_charcode_index(xdo_t *xdo);
+static int _xdo_charcode_index_of_char(const xdo_t *xdo, wchar_t key);
+static int _xdo_charcode_index_of_keysym(const xdo_t *xdo, KeySym keysym);
+static unsigned int _charcode_hash(unsigned long value);
+static void _xdo_update_free_keycodes(const xdo_t *xdo);
+static int _xdo_bind_keysym(const xdo_t *xdo, KeySym keysym,
+                            unsigned long pin);
+static void _xdo_report_unbound_keysym(KeySym keysym);
+static int _xdo_flush_keycode_bindings(const xdo_t *xdo);
+static void _xdo_restore_keycode_bindings(const xdo_t *xdo);
+static void _xdo_hold_keycode_bindings(const xdo_t *xdo);
+static void _xdo_release_keycode_bindings(const xdo_t *xdo);
+static void _xdo_check_mapping_notify(const xdo_t *xdo);
+static void _xdo_update_modifier_keycodes(const xdo_t *xdo);
+static int _xdo_use_xtest(const xdo_t *xdo, Window window);
+static void _xdo_forget_focus(const xdo_t *xdo);
+static void _xdo_check_focus_change(const xdo_t *xdo, Window window);
+static void _xdo_lock_key_group(const xdo_t *xdo, int group);
+static void _xdo_restore_key_group(const xdo_t *xdo);
+static void _xdo_stop_focus_listening(const xdo_t *xdo);
 static int _xdo_has_xtest(const xdo_t *xdo);
 
+static int _xdo_wait(const xdo_t *xdo, Window window, long event_mask,
+                     int recheck_ms, wait_check_t check,
+                     const wait_condition_t *cond);
+static int _xdo_wait_for_event(const xdo_t *xdo, Window window,
+                               long event_mask, const struct timespec *until);
+static int _wait_map_state(const xdo_t *xdo, const wait_condition_t *cond);
+static int _wait_size(const xdo_t *xdo, const wait_condition_t *cond);
+static int _wait_location(const xdo_t *xdo, const wait_condition_t *cond);
+static int _wait_active(const xdo_t *xdo, const wait_condition_t *cond);
+static int _wait_focus(const xdo_t *xdo, const wait_condition_t *cond);
+static int _wait_mouse_from(const xdo_t *xdo, const wait_condition_t *cond);
+static int _wait_mouse_to(const xdo_t *xdo, const wait_condition_t *cond);
+
+static size_t _xdo_utf8_decode(const unsigned char *bytes, size_t len,
+                               wchar_t *ch);
+static size_t _xdo_utf8_ascii_run(const char *bytes, size_t len);
+static void _xdo_key_buffer_add_char(xdo_key_buffer_t *buffer, wchar_t ch);
 static KeySym _xdo_keysym_from_char(const xdo_t *xdo, wchar_t key);
 static void _xdo_charcodemap_from_char(const xdo_t *xdo, charcodemap_t *key);
 static void _xdo_charcodemap_from_keysym(const xdo_t *xdo, charcodemap_t *key, KeySym keysym);
@@ -56,11 +266,14 @@ static void _xdo_charcodemap_from_keysym(const xdo_t *xdo, charcodemap_t *key, K
 static int _xdo_send_keysequence_window_to_keycode_list(const xdo_t *xdo, const char *keyseq,
                                             charcodemap_t **keys, int *nkeys);
 static int _xdo_send_keysequence_window_do(const xdo_t *xdo, Window window, const char *keyseq,
-                               int pressed, int *modifier, useconds_t delay);
+                               int (*send)(const xdo_keysequence_t *, Window, useconds_t),
+                               useconds_t delay);
+static const char *_xdo_symbol_alias(const char *name);
+static unsigned int _symbol_alias_hash(const char *name);
 static int _xdo_ewmh_is_supported(const xdo_t *xdo, const char *feature);
 static void _xdo_init_xkeyevent(const xdo_t *xdo, XKeyEvent *xk);
 static void _xdo_send_key(const xdo_t *xdo, Window window, charcodemap_t *key,
-                          int modstate, int is_press, useconds_t delay);
+                          int modstate, int is_press, int use_xtest);
 static void _xdo_send_modifier(const xdo_t *xdo, int modmask, int is_press);
 
 static int _xdo_query_keycode_to_modifier(XModifierKeymap *modmap, KeyCode keycode);
@@ -120,6 +333,8 @@ xdo_t* xdo_new_with_opened_display(Display *xdpy, const char *display,
     xdo->quiet = True;
   }
 
+  xdo->wait_timeout = DEFAULT_WAIT_TIMEOUT;
+
   if (_xdo_has_xtest(xdo)) {
     xdo_enable_feature(xdo, XDO_FEATURE_XTEST);
     _xdo_debug(xdo, "XTEST enabled.");
@@ -130,7 +345,17 @@ xdo_t* xdo_new_with_opened_display(Display *xdpy, const char *display,
     xdo_disable_feature(xdo, XDO_FEATURE_XTEST);
   }
 
-  _xdo_populate_charcode_map(xdo);
+  /* The keycode range comes with the connection setup, so this doesn't ask
+   * the server anything. The charcode map is only built when first needed,
+   * see _xdo_need_charcode_map. */
+  XDisplayKeycodes(xdo->xdpy, &(xdo->keycode_low), &(xdo->keycode_high));
+  xdo->keymap_cache = calloc(1, sizeof(*xdo->keymap_cache));
+
+  if (getenv("XDO_KEYMAP_CACHE")) {
+    const char *file = getenv("XDO_KEYMAP_CACHE");
+    xdo_enable_keymap_cache(xdo, *file ? file : NULL);
+  }
+
   return xdo;
 }
 
@@ -140,8 +365,18 @@ void xdo_free(xdo_t *xdo) {
 
   if (xdo->display_name)
     free(xdo->display_name);
-  if (xdo->charcodes)
-    free(xdo->charcodes);
+  if (xdo->keymap_cache) {
+    _xdo_free_charcode_map(xdo);
+    _xdo_stop_focus_listening(xdo);
+    free(xdo->keymap_cache->file);
+    free(xdo->keymap_cache->keycodes);
+    free(xdo->keymap_cache->bound);
+    free(xdo->keymap_cache->dirty);
+    free(xdo->keymap_cache->last_used);
+    free(xdo->keymap_cache);
+  }
+  if (xdo->window_index)
+    xdo_disable_window_index(xdo);
   if (xdo->xdpy && xdo->close_display_when_freed)
     XCloseDisplay(xdo->xdpy);
 
@@ -152,16 +387,145 @@ const char *xdo_version(void) {
   return XDO_VERSION;
 }
 
-int xdo_wait_for_window_map_state(const xdo_t *xdo, Window wid, int map_state) {
-  int tries = MAX_TRIES;
+/* Wait until check says the condition holds, or xdo->wait_timeout runs
+ * out. Rather than sleeping between checks, this listens for event_mask on
+ * window, for whichever events come with the change being waited for, and
+ * checks again when one arrives.
+ *
+ * Some changes come without an event we can listen for, such as a window
+ * becoming viewable because the window manager mapped its frame. For those
+ * recheck_ms says how often to look again anyway; 0 means never. */
+static int _xdo_wait(const xdo_t *xdo, Window window, long event_mask,
+                     int recheck_ms, wait_check_t check,
+                     const wait_condition_t *cond) {
   XWindowAttributes attr;
-  attr.map_state = IsUnmapped;
-  while (tries > 0 && attr.map_state != map_state) {
-    XGetWindowAttributes(xdo->xdpy, wid, &attr);
-    usleep(30000); /* TODO(sissel): Use exponential backoff up to 1 second */
-    tries--;
+  struct timespec deadline, until;
+  long added = 0;
+  int ret;
+
+  /* Listen first and check second, so a change in between isn't missed. */
+  if (XGetWindowAttributes(xdo->xdpy, window, &attr)) {
+    added = event_mask & ~attr.your_event_mask;
+    if (added)
+      XSelectInput(xdo->xdpy, window, attr.your_event_mask | added);
   }
-  return 0;
+
+  _xdo_time_after(&deadline, xdo->wait_timeout);
+
+  while ((ret = check(xdo, cond)) == 0) {
+    const struct timespec *wait_until = NULL;
+
+    if (xdo->wait_timeout > 0)
+      wait_until = &deadline;
+
+    if (recheck_ms > 0) {
+      _xdo_time_after(&until, recheck_ms);
+      if (wait_until == NULL || until.tv_sec < deadline.tv_sec
+          || (until.tv_sec == deadline.tv_sec
+              && until.tv_nsec < deadline.tv_nsec)) {
+        wait_until = &until;
+      }
+    }
+
+    if (!_xdo_wait_for_event(xdo, window, event_mask, wait_until)
+        && wait_until == &deadline) {
+      _xdo_debug(xdo, "Gave up waiting after %dms", xdo->wait_timeout);
+      ret = -1;
+      break;
+    }
+  }
+
+  /* Only take our bits back out, the rest may have changed since. */
+  if (added && XGetWindowAttributes(xdo->xdpy, window, &attr))
+    XSelectInput(xdo->xdpy, window, attr.your_event_mask & ~added);
+
+  return ret == 1 ? XDO_SUCCESS : XDO_ERROR;
+}
+
+/* Block until one of the events in event_mask arrives for window, or until
+ * the given time (never, if it is NULL). Returns False if none arrived. */
+static int _xdo_wait_for_event(const xdo_t *xdo, Window window,
+                               long event_mask, const struct timespec *until) {
+  XEvent event;
+  int got = False;
+
+  for (;;) {
+    /* This looks at what is queued and what is waiting on the connection,
+     * and flushes our requests first. */
+    while (XCheckWindowEvent(xdo->xdpy, window, event_mask, &event)) {
+      got = True;
+
+      /* The window index and focus tracking may be listening for these
+       * too, and they won't see them now. */
+      xdo_window_index_handle_event(xdo, &event);
+      if ((event.type == FocusIn || event.type == FocusOut)
+          && event.xfocus.window == xdo->keymap_cache->focus_listening) {
+        xdo->keymap_cache->focus_valid = False;
+      }
+    }
+
+    if (got)
+      return True;
+
+    /* Whatever arrives, look through it above; it may be for someone
+     * else, in which case this goes back to waiting. */
+    if (!_xdo_wait_readable(xdo, until))
+      return False;
+  }
+}
+
+void _xdo_time_after(struct timespec *when, int ms) {
+  clock_gettime(CLOCK_MONOTONIC, when);
+  when->tv_sec += ms / 1000;
+  when->tv_nsec += (ms % 1000) * 1000000L;
+  if (when->tv_nsec >= 1000000000L) {
+    when->tv_sec++;
+    when->tv_nsec -= 1000000000L;
+  }
+}
+
+int _xdo_wait_readable(const xdo_t *xdo, const struct timespec *until) {
+  int fd = ConnectionNumber(xdo->xdpy);
+  struct timespec now;
+  struct timeval timeout;
+  fd_set fds;
+
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+
+  if (until == NULL)
+    return select(fd + 1, &fds, NULL, NULL, NULL) > 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > until->tv_sec
+      || (now.tv_sec == until->tv_sec && now.tv_nsec >= until->tv_nsec))
+    return False;
+
+  timeout.tv_sec = until->tv_sec - now.tv_sec;
+  timeout.tv_usec = (until->tv_nsec - now.tv_nsec) / 1000;
+  if (timeout.tv_usec < 0) {
+    timeout.tv_sec--;
+    timeout.tv_usec += 1000000;
+  }
+
+  return select(fd + 1, &fds, NULL, NULL, &timeout) > 0;
+}
+
+static int _wait_map_state(const xdo_t *xdo, const wait_condition_t *cond) {
+  XWindowAttributes attr;
+
+  if (!XGetWindowAttributes(xdo->xdpy, cond->window, &attr))
+    return -1;
+  return attr.map_state == cond->want;
+}
+
+int xdo_wait_for_window_map_state(const xdo_t *xdo, Window wid, int map_state) {
+  wait_condition_t cond = { wid, map_state, 0, 0, 0, 0 };
+
+  /* The window's own MapNotify and UnmapNotify cover most of it, but not
+   * a parent (like a window manager frame) being mapped or unmapped. */
+  return _xdo_wait(xdo, wid, StructureNotifyMask | VisibilityChangeMask, 100,
+                   _wait_map_state, &cond);
 }
 
 int xdo_map_window(const xdo_t *xdo, Window wid) {
@@ -424,7 +788,6 @@ int xdo_focus_window(const xdo_t *xdo, Window wid) {
 int xdo_wait_for_window_size(const xdo_t *xdo, Window window,
                              unsigned int width, unsigned int height,
                              int flags, int to_or_from) {
-  unsigned int cur_width, cur_height;
   /*unsigned int alt_width, alt_height;*/
 
   //printf("Want: %udx%ud\n", width, height);
@@ -444,41 +807,64 @@ int xdo_wait_for_window_size(const xdo_t *xdo, Window window,
     //printf("Alt: %udx%ud\n", alt_width, alt_height);
   }
 
-  int tries = MAX_TRIES;
-  xdo_get_window_size(xdo, window, &cur_width,
-                      &cur_height);
+  wait_condition_t cond = { window, to_or_from, 0, 0, width, height };
+
   //printf("Want: %udx%ud\n", width, height);
   //printf("Alt: %udx%ud\n", alt_width, alt_height);
-  while (tries > 0 && (to_or_from == SIZE_TO
-         ? (cur_width != width && cur_height != height)
-         : (cur_width == width && cur_height == height))) {
-    xdo_get_window_size(xdo, window, (unsigned int *)&cur_width,
-                        (unsigned int *)&cur_height);
-    usleep(30000);
-    tries--;
+  return _xdo_wait(xdo, window, StructureNotifyMask, 0, _wait_size, &cond);
+}
+
+static int _wait_size(const xdo_t *xdo, const wait_condition_t *cond) {
+  unsigned int cur_width, cur_height;
+
+  if (xdo_get_window_size(xdo, cond->window, &cur_width, &cur_height)
+      != XDO_SUCCESS) {
+    return -1;
   }
 
-  return 0;
+  if (cond->want == SIZE_TO)
+    return !(cur_width != cond->width && cur_height != cond->height);
+  return !(cur_width == cond->width && cur_height == cond->height);
 }
 
-int xdo_wait_for_window_active(const xdo_t *xdo, Window window, int active) {
+static int _wait_active(const xdo_t *xdo, const wait_condition_t *cond) {
   Window activewin = 0;
-  int ret = 0;
-  int tries = MAX_TRIES;
 
-  /* If active is true, wait until activewin is our window
+  if (xdo_get_active_window(xdo, &activewin) == XDO_ERROR)
+    return -1;
+
+  /* If want is true, wait until activewin is our window
    * otherwise, wait until activewin is not our window */
-  while (tries > 0 &&
-         (active ? activewin != window : activewin == window)) {
-    ret = xdo_get_active_window(xdo, &activewin);
-    if (ret == XDO_ERROR) {
-      return ret;
-    }
-    usleep(30000);
-    tries--;
+  return cond->want ? activewin == cond->window : activewin != cond->window;
+}
+
+int xdo_wait_for_window_active(const xdo_t *xdo, Window window, int active) {
+  wait_condition_t cond = { window, active, 0, 0, 0, 0 };
+
+  /* The window manager changes _NET_ACTIVE_WINDOW on the root. */
+  return _xdo_wait(xdo, XDefaultRootWindow(xdo->xdpy), PropertyChangeMask, 0,
+                   _wait_active, &cond);
+}
+
+static int _wait_location(const xdo_t *xdo, const wait_condition_t *cond) {
+  int x, y;
+
+  if (xdo_get_window_location(xdo, cond->window, &x, &y, NULL)
+      != XDO_SUCCESS) {
+    return -1;
   }
+  return !(x == cond->x && y == cond->y);
+}
 
-  return 0;
+int xdo_wait_for_window_move_from(const xdo_t *xdo, Window window,
+                                  int origin_x, int origin_y) {
+  wait_condition_t cond = { window, 0, origin_x, origin_y, 0, 0 };
+
+  /* If the window manager has reparented the window, it moves the frame
+   * and tells the window with a synthetic ConfigureNotify, as the ICCCM
+   * asks. Not every window manager does, so look again every 100ms too. */
+  return _xdo_wait(xdo, window, StructureNotifyMask, 100, _wait_location,
+                   &cond);
 }
 
 int xdo_activate_window(const xdo_t *xdo, Window wid) {
@@ -986,151 +1372,392 @@ int xdo_click_window_multiple(const xdo_t *xdo, Window window, int button,
   return ret;
 } /* int xdo_click_window_multiple */
 
-/* XXX: Return proper code if errors found */
 int xdo_enter_text_window(const xdo_t *xdo, Window window, const char *string, useconds_t delay) {
+  xdo_key_buffer_t *buffer = xdo_key_buffer_new(xdo, delay);
+  int ret;
+
+  ret = xdo_key_buffer_add_text(buffer, string);
+  if (ret == XDO_SUCCESS)
+    ret = xdo_key_buffer_play(buffer, window);
+
+  xdo_key_buffer_free(buffer);
+  return ret;
+}
+
+xdo_key_buffer_t *xdo_key_buffer_new(const xdo_t *xdo, useconds_t delay) {
+  xdo_key_buffer_t *buffer = calloc(1, sizeof(xdo_key_buffer_t));
+
+  buffer->xdo = xdo;
+  buffer->delay = delay;
+  return buffer;
+}
+
+void xdo_key_buffer_free(xdo_key_buffer_t *buffer) {
+  if (buffer == NULL)
+    return;
+
+  free(buffer->events);
+  free(buffer);
+}
+
+int xdo_key_buffer_add_text(xdo_key_buffer_t *buffer, const char *string) {
+  int nevents = buffer->nevents;
+
+  if (xdo_key_buffer_add_bytes(buffer, string, strlen(string)) == XDO_ERROR)
+    return XDO_ERROR;
+
+  /* The string has to end with a whole character. */
+  if (xdo_key_buffer_finish(buffer) == XDO_ERROR) {
+    buffer->nevents = nevents;
+    return XDO_ERROR;
+  }
+
+  return XDO_SUCCESS;
+}
+
+int xdo_key_buffer_finish(xdo_key_buffer_t *buffer) {
+  if (buffer->npartial == 0)
+    return XDO_SUCCESS;
+
+  fprintf(stderr, "Invalid multi-byte sequence encountered\n");
+  buffer->npartial = 0;
+  return XDO_ERROR;
+}
+
+int xdo_key_buffer_add_bytes(xdo_key_buffer_t *buffer, const char *bytes,
+                             size_t len) {
+  int nevents = buffer->nevents;
+  wchar_t ch;
+  size_t n;
+
+  /* Each byte is at most one character, which is two events. */
+  int needed = nevents + 2 * len;
+
+  if (buffer->size < needed) {
+    buffer->size = needed;
+    buffer->events = realloc(buffer->events,
+                             buffer->size * sizeof(struct xdo_key_event));
+  }
+
+  /* Look characters up in the current keymap, not one another client has
+   * since changed. Once per call, not per character. */
+  _xdo_check_mapping_notify(buffer->xdo);
+
+  /* Finish the character the last call ended partway through. */
+  while (buffer->npartial > 0 && len > 0) {
+    buffer->partial[buffer->npartial++] = *bytes++;
+    len--;
+
+    n = _xdo_utf8_decode(buffer->partial, buffer->npartial, &ch);
+    if (n == (size_t)-1)
+      goto invalid;
+
+    if (n != (size_t)-2) {
+      buffer->npartial = 0;
+      _xdo_key_buffer_add_char(buffer, ch);
+    }
+  }
+
+  while (len > 0) {
+    /* Text is mostly ASCII, which needs no decoding. */
+    n = _xdo_utf8_ascii_run(bytes, len);
+    len -= n;
+    while (n-- > 0)
+      _xdo_key_buffer_add_char(buffer, *bytes++);
+
+    if (len == 0)
+      break;
+
+    n = _xdo_utf8_decode((const unsigned char *)bytes, len, &ch);
+    if (n == (size_t)-1)
+      goto invalid;
+
+    /* Keep the start of the character until the rest of it comes along. */
+    if (n == (size_t)-2) {
+      memcpy(buffer->partial, bytes, len);
+      buffer->npartial = len;
+      break;
+    }
+
+    _xdo_key_buffer_add_char(buffer, ch);
+    bytes += n;
+    len -= n;
+  } /* walk bytes generating key events */
+
+  return XDO_SUCCESS;
+
+invalid:
+  /* Only keep the text if all of it made sense. */
+  fprintf(stderr, "Invalid multi-byte sequence encountered\n");
+  buffer->npartial = 0;
+  buffer->nevents = nevents;
+  return XDO_ERROR;
+}
+
+/* Add the press and release of the key that types ch. */
+static void _xdo_key_buffer_add_char(xdo_key_buffer_t *buffer, wchar_t ch) {
+  charcodemap_t key;
+  int i;
 
   /* Since we're doing down/up, the delay should be based on the number
-   * of keys pressed (including shift). Since up/down is two calls,
-   * divide by two. */
-  delay /= 2;
+   * of keys pressed (including shift). Since up/down is two events,
+   * divide by two, and split that again between the press and the
+   * release. */
+  useconds_t delay = buffer->delay / 2 / 2;
+
+  /* There is no key for a NUL. */
+  if (ch == L'\0')
+    return;
+
+  key.key = ch;
+  _xdo_charcodemap_from_char(buffer->xdo, &key);
+  if (key.code == 0 && key.symbol == NoSymbol) {
+    fprintf(stderr, "I don't know which key produces '%lc', skipping.\n",
+            key.key);
+    return;
+  }
+
+  for (i = 0; i < 2; i++) {
+    struct xdo_key_event *event = &buffer->events[buffer->nevents++];
+
+    event->symbol = key.symbol;
+    event->code = (key.needs_binding == 1) ? 0 : key.code;
+    event->group = key.group;
+    event->modmask = key.modmask;
+    event->pressed = (i == 0);
+    event->delay = delay;
+  }
+}
+
+void xdo_key_buffer_clear(xdo_key_buffer_t *buffer) {
+  buffer->nevents = 0;
+}
 
-  /* XXX: Add error handling */
-  //int nkeys = strlen(string);
-  //charcodemap_t *keys = calloc(nkeys, sizeof(charcodemap_t));
+int xdo_key_buffer_play(const xdo_key_buffer_t *buffer, Window window) {
+  const xdo_t *xdo = buffer->xdo;
+  const struct xdo_key_event *events = buffer->events;
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  KeyCode *codes;
   charcodemap_t key;
-  //int modifier = 0;
-  setlocale(LC_CTYPE,"");
-  mbstate_t ps = { 0 };
-  ssize_t len;
-  while ( (len = mbsrtowcs(&key.key, &string, 1, &ps)) ) {
-    if (len == -1) {
-      fprintf(stderr, "Invalid multi-byte sequence encountered\n");
-      return XDO_ERROR;
-    }
-    _xdo_charcodemap_from_char(xdo, &key);
-    if (key.code == 0 && key.symbol == NoSymbol) {
-      fprintf(stderr, "I don't know which key produces '%lc', skipping.\n",
-              key.key);
-      continue;
-    } else {
-      //printf("Found key for %c\n", key.key);
-      //printf("code: %d\n", key.code);
-      //printf("sym: %s\n", XKeysymToString(key.symbol));
+  int i = 0, j, start;
+  unsigned long pin;
+  int use_xtest;
+
+  if (buffer->nevents == 0)
+    return XDO_SUCCESS;
+
+  /* The keycodes the events are sent with, once the ones for unmapped
+   * keysyms are bound. */
+  codes = malloc(buffer->nevents * sizeof(KeyCode));
+
+  /* Keep keysyms bound to spare keycodes until the whole buffer is played,
+   * so characters that come up again don't need binding again. */
+  _xdo_hold_keycode_bindings(xdo);
+  _xdo_update_free_keycodes(xdo);
+  use_xtest = _xdo_use_xtest(xdo, window);
+  memset(&key, 0, sizeof(key));
+
+  for (start = 0; start < buffer->nevents; start = i) {
+    pin = ++cache->clock;
+
+    /* Bind as many keysyms as there are spare keycodes for, so the changes
+     * go out together, same as xdo_send_keysequence_window_list_do. */
+    for (i = start; i < buffer->nevents; i++) {
+      codes[i] = events[i].code;
+      if (codes[i] == 0) {
+        codes[i] = _xdo_bind_keysym(xdo, events[i].symbol, pin);
+
+        /* Out of keycodes; send what's bound so far first. If nothing is,
+         * there is no keycode for this one at all. */
+        if (codes[i] == 0 && i > start)
+          break;
+        if (codes[i] == 0 && events[i].pressed)
+          _xdo_report_unbound_keysym(events[i].symbol);
+      }
     }
 
-    //printf(stderr,
-            //"Key '%c' maps to code %d / sym %lu in group %d / mods %d (%s)\n",
-            //key.key, key.code, key.symbol, key.group, key.modmask,
-            //(key.needs_binding == 1) ? "needs binding" : "ok");
+    if (_xdo_flush_keycode_bindings(xdo))
+      XSync(xdo->xdpy, False);
+
+    for (j = start; j < i; j++) {
+      if (codes[j] == 0)
+        continue;
 
-    //_xdo_send_key(xdo, window, keycode, modstate, True, delay);
-    //_xdo_send_key(xdo, window, keycode, modstate, False, delay);
-    xdo_send_keysequence_window_list_do(xdo, window, &key, 1, True, NULL, delay / 2);
-    key.needs_binding = 0;
-    xdo_send_keysequence_window_list_do(xdo, window, &key, 1, False, NULL, delay / 2);
+      /* Only XTest needs the group locked. */
+      if (use_xtest)
+        _xdo_lock_key_group(xdo, events[j].group);
+
+      key.code = codes[j];
+      key.group = events[j].group;
+      key.modmask = events[j].modmask;
+      _xdo_send_key(xdo, window, &key, 0, events[j].pressed, use_xtest);
+
+      /* Without a delay, everything queues up and goes out as the output
+       * buffer fills. */
+      if (events[j].delay > 0) {
+        XFlush(xdo->xdpy);
+        usleep(events[j].delay);
+
+        /* The focus may move while we sleep between characters. */
+        if (!events[j].pressed) {
+          _xdo_forget_focus(xdo);
+          use_xtest = _xdo_use_xtest(xdo, window);
+        }
+      }
+    }
+  }
 
-    /* XXX: Flush here or at the end? or never? */
-    //XFlush(xdo->xdpy);
-  } /* walk string generating a keysequence */
+  _xdo_release_keycode_bindings(xdo);
+  XFlush(xdo->xdpy);
 
-  //free(keys);
+  free(codes);
   return XDO_SUCCESS;
 }
 
 int _xdo_send_keysequence_window_do(const xdo_t *xdo, Window window, const char *keyseq,
-                        int pressed, int *modifier, useconds_t delay) {
-  int ret = 0;
-  charcodemap_t *keys = NULL;
-  int nkeys = 0;
+                        int (*send)(const xdo_keysequence_t *, Window, useconds_t),
+                        useconds_t delay) {
+  xdo_keysequence_t *seq = xdo_keysequence_new(xdo, keyseq);
+  int ret;
 
-  if (_xdo_send_keysequence_window_to_keycode_list(xdo, keyseq, &keys, &nkeys) == False) {
+  if (seq == NULL) {
     fprintf(stderr, "Failure converting key sequence '%s' to keycodes\n", keyseq);
     return 1;
   }
 
-  ret = xdo_send_keysequence_window_list_do(xdo, window, keys, nkeys, pressed, modifier, delay);
-  if (keys != NULL) {
-    free(keys);
+  ret = send(seq, window, delay);
+  xdo_keysequence_free(seq);
+  return ret;
+}
+
+xdo_keysequence_t *xdo_keysequence_new(const xdo_t *xdo, const char *keyseq) {
+  xdo_keysequence_t *seq = calloc(1, sizeof(xdo_keysequence_t));
+
+  seq->xdo = xdo;
+  if (_xdo_send_keysequence_window_to_keycode_list(xdo, keyseq, &seq->keys,
+                                                   &seq->nkeys) == False) {
+    xdo_keysequence_free(seq);
+    return NULL;
   }
 
-  return ret;
+  return seq;
+}
+
+void xdo_keysequence_free(xdo_keysequence_t *seq) {
+  if (seq == NULL)
+    return;
+
+  free(seq->keys);
+  free(seq);
+}
+
+int xdo_keysequence_send(const xdo_keysequence_t *seq, Window window,
+                         useconds_t delay) {
+  const xdo_t *xdo = seq->xdo;
+  int modifier = 0;
+
+  /* Hold on to the bindings (and whether to use XTest) from the press
+   * through the release. */
+  _xdo_hold_keycode_bindings(xdo);
+  xdo_send_keysequence_window_list_do(xdo, window, seq->keys, seq->nkeys,
+                                      True, &modifier, delay / 2);
+  xdo_send_keysequence_window_list_do(xdo, window, seq->keys, seq->nkeys,
+                                      False, &modifier, delay / 2);
+  _xdo_release_keycode_bindings(xdo);
+  return XDO_SUCCESS;
+}
+
+int xdo_keysequence_send_down(const xdo_keysequence_t *seq, Window window,
+                              useconds_t delay) {
+  return xdo_send_keysequence_window_list_do(seq->xdo, window, seq->keys,
+                                             seq->nkeys, True, NULL, delay);
+}
+
+int xdo_keysequence_send_up(const xdo_keysequence_t *seq, Window window,
+                            useconds_t delay) {
+  return xdo_send_keysequence_window_list_do(seq->xdo, window, seq->keys,
+                                             seq->nkeys, False, NULL, delay);
+}
+
+void xdo_keysequence_begin(const xdo_t *xdo) {
+  _xdo_hold_keycode_bindings(xdo);
+}
+
+void xdo_keysequence_end(const xdo_t *xdo) {
+  _xdo_release_keycode_bindings(xdo);
 }
 
 int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window, charcodemap_t *keys,
                             int nkeys, int pressed, int *modifier, useconds_t delay) {
-  int i = 0;
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  int i = 0, j, start;
   int modstate = 0;
-  int keymapchanged = 0;
-
-  /* Find an unused keycode in case we need to bind unmapped keysyms */
-  KeySym *keysyms = NULL;
-  int keysyms_per_keycode = 0;
-  int scratch_keycode = 0; /* Scratch space for temporary keycode bindings */
-  keysyms = XGetKeyboardMapping(xdo->xdpy, xdo->keycode_low,
-                                xdo->keycode_high - xdo->keycode_low,
-                                &keysyms_per_keycode);
-
-  /* Find a keycode that is unused for scratchspace */
-  for (i = xdo->keycode_low; i <= xdo->keycode_high; i++) {
-    int j = 0;
-    int key_is_empty = 1;
-    for (j = 0; j < keysyms_per_keycode; j++) {
-      /*char *symname;*/
-      int symindex = (i - xdo->keycode_low) * keysyms_per_keycode + j;
-      /*symname = XKeysymToString(keysyms[symindex]);*/
-      if (keysyms[symindex] != 0) {
-        key_is_empty = 0;
-      } else {
-        break;
-      }
-    }
-    if (key_is_empty) {
-      scratch_keycode = i;
-      break;
-    }
-  }
-  free(keysyms);
+  unsigned long pin;
+  int use_xtest;
 
   /* Allow passing NULL for modifier in case we don't care about knowing
    * the modifier map state after we finish */
   if (modifier == NULL)
     modifier = &modstate;
 
-  for (i = 0; i < nkeys; i++) {
-    if (keys[i].needs_binding == 1) {
-      KeySym keysym_list[] = { keys[i].symbol };
-      _xdo_debug(xdo, "Mapping sym %lu to %d", keys[i].symbol, scratch_keycode);
-      XChangeKeyboardMapping(xdo->xdpy, scratch_keycode, 1, keysym_list, 1);
-      XSync(xdo->xdpy, False);
-      /* override the code in our current key to use the scratch_keycode */
-      keys[i].code = scratch_keycode;
-      keymapchanged = 1;
-    }
+  _xdo_hold_keycode_bindings(xdo);
+  _xdo_update_free_keycodes(xdo);
+  use_xtest = _xdo_use_xtest(xdo, window);
 
-    //fprintf(stderr, "keyseqlist_do: Sending %lc %s (%d, mods %x)\n",
-            //keys[i].key, (pressed ? "down" : "up"), keys[i].code, *modifier);
-    _xdo_send_key(xdo, window, &(keys[i]), *modifier, pressed, delay);
+  for (start = 0; start < nkeys; start = i) {
+    /* Keycodes bound for keys not sent yet must not be rebound. */
+    pin = ++cache->clock;
 
-    if (keys[i].needs_binding == 1) {
-      /* If we needed to make a new keymapping for this keystroke, we
-       * should sync with the server now, after the keypress, so that
-       * the next mapping or removal doesn't conflict. */
-      XSync(xdo->xdpy, False);
+    /* Bind unmapped keysyms to free keycodes for as many keys as there are
+     * keycodes for, so the changes go out together. */
+    for (i = start; i < nkeys; i++) {
+      if (keys[i].needs_binding == 1) {
+        int code = _xdo_bind_keysym(xdo, keys[i].symbol, pin);
+
+        /* Out of keycodes; send what's bound so far first. If nothing is,
+         * there is no keycode for this one at all. */
+        if (code == 0 && i > start)
+          break;
+        if (code == 0)
+          _xdo_report_unbound_keysym(keys[i].symbol);
+
+        /* override the code in our current key to use the scratch keycode */
+        keys[i].code = code;
+      }
     }
 
-    if (pressed) {
-      *modifier |= keys[i].modmask;
-    } else {
-      *modifier &= ~(keys[i].modmask);
+    /* Sync so the new mapping is in place before the keys that use it. */
+    if (_xdo_flush_keycode_bindings(xdo))
+      XSync(xdo->xdpy, False);
+
+    for (j = start; j < i; j++) {
+      if (keys[j].code == 0)
+        continue;
+
+      if (use_xtest)
+        _xdo_lock_key_group(xdo, keys[j].group);
+
+      //fprintf(stderr, "keyseqlist_do: Sending %lc %s (%d, mods %x)\n",
+              //keys[j].key, (pressed ? "down" : "up"), keys[j].code, *modifier);
+      _xdo_send_key(xdo, window, &(keys[j]), *modifier, pressed, use_xtest);
+
+      if (pressed) {
+        *modifier |= keys[j].modmask;
+      } else {
+        *modifier &= ~(keys[j].modmask);
+      }
+
+      /* The events queue up and go out together, unless they're to be
+       * spaced out. Skipping the usleep if delay is 0 is much faster than
+       * calling usleep(0) */
+      if (delay > 0) {
+        XFlush(xdo->xdpy);
+        usleep(delay);
+      }
     }
   }
 
-  if (keymapchanged) {
-    KeySym keysym_list[] = { 0 };
-    _xdo_debug(xdo, "Reverting scratch keycode (sym %lu to %d)",
-              keys[i].symbol, scratch_keycode);
-    XChangeKeyboardMapping(xdo->xdpy, scratch_keycode, 1, keysym_list, 1);
-  }
+  _xdo_release_keycode_bindings(xdo);
 
   /* Necessary? */
   XFlush(xdo->xdpy);
@@ -1139,25 +1766,20 @@ int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window, charcod
 
 int xdo_send_keysequence_window_down(const xdo_t *xdo, Window window, const char *keyseq,
                          useconds_t delay) {
-  return _xdo_send_keysequence_window_do(xdo, window, keyseq, True, NULL, delay);
+  return _xdo_send_keysequence_window_do(xdo, window, keyseq,
+                                         xdo_keysequence_send_down, delay);
 }
 
 int xdo_send_keysequence_window_up(const xdo_t *xdo, Window window, const char *keyseq,
                        useconds_t delay) {
-  return _xdo_send_keysequence_window_do(xdo, window, keyseq, False, NULL, delay);
+  return _xdo_send_keysequence_window_do(xdo, window, keyseq,
+                                         xdo_keysequence_send_up, delay);
 }
 
 int xdo_send_keysequence_window(const xdo_t *xdo, Window window, const char *keyseq,
                     useconds_t delay) {
-  int ret = 0;
-  int modifier = 0;
-  ret += _xdo_send_keysequence_window_do(xdo, window, keyseq, True, &modifier, delay / 2);
-
-  if (ret == 1)
-    return ret;
-
-  ret += _xdo_send_keysequence_window_do(xdo, window, keyseq, False, &modifier, delay / 2);
-  return ret;
+  return _xdo_send_keysequence_window_do(xdo, window, keyseq,
+                                         xdo_keysequence_send, delay);
 }
 
 /* Add by Lee Pumphret 2007-07-28
@@ -1179,30 +1801,23 @@ int xdo_get_focused_window(const xdo_t *xdo, Window *window_ret) {
   return _is_success("XGetInputFocus", ret == 0, xdo);
 }
 
-int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus) {
+static int _wait_focus(const xdo_t *xdo, const wait_condition_t *cond) {
   Window focuswin = 0;
-  int ret;
-  int tries = MAX_TRIES;
-  ret = xdo_get_focused_window(xdo, &focuswin);
-  if (ret != 0) {
-    return ret;
-  }
 
-  while (tries > 0 &&
-         (want_focus ? focuswin != window : focuswin == window)) {
-    usleep(30000); /* TODO(sissel): Use exponential backoff up to 1 second */
-    ret = xdo_get_focused_window(xdo, &focuswin);
-    if (ret != 0) {
-      return ret;
-    }
-    tries--;
-  }
-  return 0;
+  if (xdo_get_focused_window(xdo, &focuswin) != XDO_SUCCESS)
+    return -1;
+  return cond->want ? focuswin == cond->window : focuswin != cond->window;
 }
 
-/* Like xdo_get_focused_window, but return the first ancestor-or-self window
- * having a property of WM_CLASS. This allows you to get the "real" or
- * top-level-ish window having focus rather than something you may
+int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus) {
+  wait_condition_t cond = { window, want_focus, 0, 0, 0, 0 };
+
+  return _xdo_wait(xdo, window, FocusChangeMask, 0, _wait_focus, &cond);
+}
+
+/* Like xdo_get_focused_window, but return the first ancestor-or-self window
+ * having a property of WM_CLASS. This allows you to get the "real" or
+ * top-level-ish window having focus rather than something you may
  * not expect to be the window having focused. */
 int xdo_get_focused_window_sane(const xdo_t *xdo, Window *window_ret) {
   xdo_get_focused_window(xdo, window_ret);
@@ -1273,20 +1888,34 @@ int xdo_find_window_client(const xdo_t *xdo, Window window, Window *window_ret,
   return XDO_SUCCESS;
 }
 
+int xdo_refresh_keyboard_mapping(xdo_t *xdo) {
+  _xdo_free_charcode_map(xdo);
+
+  /* Read again the next time a key is looked up. */
+  xdo->keymap_cache->valid = False;
+  xdo->keymap_cache->own_changes = 0;
+  return XDO_SUCCESS;
+}
+
+int xdo_enable_focus_tracking(xdo_t *xdo) {
+  xdo->keymap_cache->focus_tracking = True;
+  xdo->keymap_cache->focus_window = None;
+  xdo->keymap_cache->focus_valid = False;
+  return XDO_SUCCESS;
+}
+
+void xdo_disable_focus_tracking(xdo_t *xdo) {
+  _xdo_stop_focus_listening(xdo);
+  xdo->keymap_cache->focus_tracking = False;
+  xdo->keymap_cache->focus_valid = False;
+}
+
 /* Helper functions */
 static KeySym _xdo_keysym_from_char(const xdo_t *xdo, wchar_t key) {
-  int i = 0;
-  int len = xdo->charcodes_len;
-
-  //printf("Finding symbol for key '%c'\n", key);
-  for (i = 0; i < len; i++) {
-    //printf("  => %c vs %c (%d)\n",
-           //key, xdo->charcodes[i].key, (xdo->charcodes[i].key == key));
-    if (xdo->charcodes[i].key == key) {
-      //printf("  => MATCH to symbol: %lu\n", xdo->charcodes[i].symbol);
-      return xdo->charcodes[i].symbol;
-    }
-  }
+  int i = _xdo_charcode_index_of_char(xdo, key);
+
+  if (i != -1)
+    return xdo->charcodes[i].symbol;
 
   if (key >= 0x100) key += 0x01000000;
   if (XKeysymToString(key)) return key;
@@ -1307,8 +1936,7 @@ static void _xdo_charcodemap_from_char(const xdo_t *xdo, charcodemap_t *key) {
 }
 
 static void _xdo_charcodemap_from_keysym(const xdo_t *xdo, charcodemap_t *key, KeySym keysym) {
-  int i = 0;
-  int len = xdo->charcodes_len;
+  int i = _xdo_charcode_index_of_keysym(xdo, keysym);
 
   key->code = 0;
   key->symbol = keysym;
@@ -1316,14 +1944,11 @@ static void _xdo_charcodemap_from_keysym(const xdo_t *xdo, charcodemap_t *key, K
   key->modmask = 0;
   key->needs_binding = 1;
 
-  for (i = 0; i < len; i++) {
-    if (xdo->charcodes[i].symbol == keysym) {
-      key->code = xdo->charcodes[i].code;
-      key->group = xdo->charcodes[i].group;
-      key->modmask = xdo->charcodes[i].modmask;
-      key->needs_binding = 0;
-      return;
-    }
+  if (i != -1) {
+    key->code = xdo->charcodes[i].code;
+    key->group = xdo->charcodes[i].group;
+    key->modmask = xdo->charcodes[i].modmask;
+    key->needs_binding = 0;
   }
 }
 
@@ -1332,13 +1957,327 @@ static int _xdo_has_xtest(const xdo_t *xdo) {
   return (XTestQueryExtension(xdo->xdpy, &dummy, &dummy, &dummy, &dummy) == True);
 }
 
+/* Most commands never send a key, so the charcode map is built the first
+ * time a character or keysym is looked up rather than in xdo_new. */
+static void _xdo_need_charcode_map(const xdo_t *xdo) {
+  if (xdo->charcode_index == NULL)
+    _xdo_populate_charcode_map((xdo_t *)xdo);
+}
+
 static void _xdo_populate_charcode_map(xdo_t *xdo) {
   /* assert xdo->display is valid */
+  uint64_t fingerprint = 0;
+
+  if (xdo->keymap_cache->file != NULL) {
+    fingerprint = _xdo_keymap_fingerprint(xdo);
+    if (fingerprint != 0 && _xdo_load_keymap_cache(xdo, fingerprint))
+      return;
+  }
+
+#ifdef HAVE_XKBCOMMON_X11
+  if (!_xdo_populate_charcode_map_xkbcommon(xdo))
+#endif
+    _xdo_populate_charcode_map_xlib(xdo);
+
+  _xdo_index_charcode_map(xdo);
+
+  if (fingerprint != 0)
+    _xdo_save_keymap_cache(xdo, fingerprint);
+}
+
+static void _xdo_free_charcode_map(xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+
+  _xdo_free_charcode_index(xdo);
+
+  if (cache->mapped != NULL) {
+    munmap(cache->mapped, cache->mapped_size);
+    cache->mapped = NULL;
+  } else {
+    free(xdo->charcodes);
+  }
+
+  xdo->charcodes = NULL;
+  xdo->charcodes_len = 0;
+}
+
+#define FNV1A_INIT 14695981039346656037ULL
+
+static uint64_t _xdo_fnv1a(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *p = data;
+  size_t i;
+
+  for (i = 0; i < size; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* Hash the core keyboard and modifier mappings, asked for together so it
+ * costs one round trip. Returns 0 if they couldn't be read. */
+static uint64_t _xdo_keymap_fingerprint(const xdo_t *xdo) {
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  xcb_get_keyboard_mapping_cookie_t keyboard_cookie;
+  xcb_get_modifier_mapping_cookie_t modmap_cookie;
+  xcb_get_keyboard_mapping_reply_t *keyboard;
+  xcb_get_modifier_mapping_reply_t *modmap;
+  uint64_t hash = FNV1A_INIT;
+  int values[4];
+
+  keyboard_cookie = xcb_get_keyboard_mapping(xcb, xdo->keycode_low,
+      xdo->keycode_high - xdo->keycode_low + 1);
+  modmap_cookie = xcb_get_modifier_mapping(xcb);
+  keyboard = xcb_get_keyboard_mapping_reply(xcb, keyboard_cookie, NULL);
+  modmap = xcb_get_modifier_mapping_reply(xcb, modmap_cookie, NULL);
+
+  if (keyboard == NULL || modmap == NULL) {
+    free(keyboard);
+    free(modmap);
+    return 0;
+  }
+
+  /* Which code builds the map is part of it, too. */
+  values[0] = xdo->keycode_low;
+  values[1] = xdo->keycode_high;
+  values[2] = keyboard->keysyms_per_keycode;
+#ifdef HAVE_XKBCOMMON_X11
+  values[3] = 1;
+#else
+  values[3] = 0;
+#endif
+
+  hash = _xdo_fnv1a(hash, values, sizeof(values));
+  hash = _xdo_fnv1a(hash, xcb_get_keyboard_mapping_keysyms(keyboard),
+                    xcb_get_keyboard_mapping_keysyms_length(keyboard)
+                    * sizeof(xcb_keysym_t));
+  hash = _xdo_fnv1a(hash, xcb_get_modifier_mapping_keycodes(modmap),
+                    xcb_get_modifier_mapping_keycodes_length(modmap)
+                    * sizeof(xcb_keycode_t));
+
+  free(keyboard);
+  free(modmap);
+  return hash ? hash : 1;
+}
+
+/* Use the charcode map in the cache file if it was made for this keymap.
+ * Returns False if there is no such file, or it is for something else. */
+static int _xdo_load_keymap_cache(xdo_t *xdo, uint64_t fingerprint) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  const struct keymap_cache_header *header;
+  struct xdo_charcode_index *index;
+  struct stat st;
+  unsigned char *map;
+  size_t size;
+  int fd;
+
+  fd = open(cache->file, O_RDONLY);
+  if (fd == -1)
+    return False;
+
+  if (fstat(fd, &st) == -1
+      || (size_t)st.st_size < KEYMAP_CACHE_CHARCODES) {
+    close(fd);
+    return False;
+  }
+
+  size = st.st_size;
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return False;
+
+  header = (const struct keymap_cache_header *)map;
+  if (memcmp(header->magic, KEYMAP_CACHE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != KEYMAP_CACHE_VERSION
+      || header->charcode_size != sizeof(charcodemap_t)
+      || header->fingerprint != fingerprint) {
+    _xdo_debug(xdo, "Keymap cache %s is out of date", cache->file);
+    munmap(map, size);
+    return False;
+  }
+
+  if (!_xdo_check_keymap_cache(map, size)
+      || _xdo_keymap_cache_checksum(header, map + KEYMAP_CACHE_CHARCODES,
+                                    size - KEYMAP_CACHE_CHARCODES)
+         != header->checksum) {
+    _xdo_debug(xdo, "Keymap cache %s is damaged", cache->file);
+    munmap(map, size);
+    return False;
+  }
+
+  index = calloc(1, sizeof(*index));
+  memcpy(index->latin_chars, header->latin_chars, sizeof(index->latin_chars));
+  memcpy(index->latin_keysyms, header->latin_keysyms,
+         sizeof(index->latin_keysyms));
+  index->mask = header->mask;
+  index->mapped = True;
+
+  xdo->charcodes = (charcodemap_t *)(map + KEYMAP_CACHE_CHARCODES);
+  xdo->charcodes_len = header->charcodes_len;
+  xdo->keysyms_per_keycode = header->keysyms_per_keycode;
+  index->chars = (int *)(xdo->charcodes + xdo->charcodes_len);
+  index->keysyms = index->chars + index->mask + 1;
+  xdo->charcode_index = index;
+
+  cache->mapped = map;
+  cache->mapped_size = size;
+  _xdo_debug(xdo, "Using keymap cache %s", cache->file);
+  return True;
+}
+
+/* Hash what the header's checksum covers, or the start of it: the latin
+ * tables, then size bytes from data on. */
+static uint64_t _xdo_keymap_cache_checksum(
+    const struct keymap_cache_header *header, const void *data, size_t size) {
+  uint64_t hash = FNV1A_INIT;
+
+  hash = _xdo_fnv1a(hash, header->latin_chars, sizeof(header->latin_chars));
+  hash = _xdo_fnv1a(hash, header->latin_keysyms,
+                    sizeof(header->latin_keysyms));
+  return _xdo_fnv1a(hash, data, size);
+}
+
+/* The lookups trust the tables completely, so check everything they use
+ * before a file is: that the sizes add up to the file's, that the hash
+ * tables are a power of two in size and have an empty slot to stop a
+ * probe, and that every entry is -1 or a charcode. */
+static int _xdo_check_keymap_cache(const unsigned char *map, size_t size) {
+  const struct keymap_cache_header *header =
+    (const struct keymap_cache_header *)map;
+  size_t nslots = (size_t)header->mask + 1;
+  size_t charcodes_size, i;
+  const int *tables;
+  int chars_empty = False, keysyms_empty = False;
+  int len = header->charcodes_len;
+
+  if (len < 0 || nslots == 0 || (nslots & (nslots - 1)) != 0)
+    return False;
+
+  /* Sizes are checked one at a time, so none of them can overflow. */
+  size -= KEYMAP_CACHE_CHARCODES;
+  if ((size_t)len > size / sizeof(charcodemap_t))
+    return False;
+  charcodes_size = len * sizeof(charcodemap_t);
+  if (nslots > (size - charcodes_size) / (2 * sizeof(int))
+      || size != charcodes_size + 2 * nslots * sizeof(int))
+    return False;
+
+  for (i = 0; i < CHARCODE_LATIN_SIZE; i++) {
+    if (header->latin_chars[i] < -1 || header->latin_chars[i] >= len
+        || header->latin_keysyms[i] < -1 || header->latin_keysyms[i] >= len)
+      return False;
+  }
+
+  tables = (const int *)(map + KEYMAP_CACHE_CHARCODES + charcodes_size);
+  for (i = 0; i < 2 * nslots; i++) {
+    if (tables[i] < -1 || tables[i] >= len)
+      return False;
+    if (tables[i] == -1) {
+      if (i < nslots)
+        chars_empty = True;
+      else
+        keysyms_empty = True;
+    }
+  }
+
+  return chars_empty && keysyms_empty;
+}
+
+/* Write the charcode map out for the next process. The file is written
+ * under another name and renamed into place, so a reader never sees half
+ * of it. Failing to write it is not an error. */
+static void _xdo_save_keymap_cache(const xdo_t *xdo, uint64_t fingerprint) {
+  const struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  const struct xdo_charcode_index *index = xdo->charcode_index;
+  struct keymap_cache_header header;
+  char padding[KEYMAP_CACHE_CHARCODES - sizeof(header) + 1];
+  size_t tablesize = ((size_t)index->mask + 1) * sizeof(int);
+  char *tmpfile;
+  FILE *fp;
+  int fd, ok;
+
+  memset(&header, 0, sizeof(header));
+  memset(padding, 0, sizeof(padding));
+  memcpy(header.magic, KEYMAP_CACHE_MAGIC, sizeof(header.magic));
+  header.version = KEYMAP_CACHE_VERSION;
+  header.charcode_size = sizeof(charcodemap_t);
+  header.fingerprint = fingerprint;
+  header.keysyms_per_keycode = xdo->keysyms_per_keycode;
+  header.charcodes_len = xdo->charcodes_len;
+  header.mask = index->mask;
+  memcpy(header.latin_chars, index->latin_chars, sizeof(header.latin_chars));
+  memcpy(header.latin_keysyms, index->latin_keysyms,
+         sizeof(header.latin_keysyms));
+  header.checksum = _xdo_keymap_cache_checksum(&header, xdo->charcodes,
+      xdo->charcodes_len * sizeof(charcodemap_t));
+  header.checksum = _xdo_fnv1a(header.checksum, index->chars, tablesize);
+  header.checksum = _xdo_fnv1a(header.checksum, index->keysyms, tablesize);
+
+  tmpfile = malloc(strlen(cache->file) + sizeof(".XXXXXX"));
+  sprintf(tmpfile, "%s.XXXXXX", cache->file);
+
+  fd = mkstemp(tmpfile);
+  if (fd == -1 || (fp = fdopen(fd, "w")) == NULL) {
+    _xdo_debug(xdo, "Can't write keymap cache %s", cache->file);
+    if (fd != -1) {
+      close(fd);
+      unlink(tmpfile);
+    }
+    free(tmpfile);
+    return;
+  }
+
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1
+       && fwrite(padding, KEYMAP_CACHE_CHARCODES - sizeof(header), 1, fp) <= 1
+       && fwrite(xdo->charcodes, sizeof(charcodemap_t), xdo->charcodes_len, fp)
+          == (size_t)xdo->charcodes_len
+       && fwrite(index->chars, tablesize, 1, fp) == 1
+       && fwrite(index->keysyms, tablesize, 1, fp) == 1;
+
+  if (fclose(fp) != 0 || !ok || rename(tmpfile, cache->file) == -1) {
+    _xdo_debug(xdo, "Can't write keymap cache %s", cache->file);
+    unlink(tmpfile);
+  }
+
+  free(tmpfile);
+}
+
+int xdo_enable_keymap_cache(xdo_t *xdo, const char *file) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  const char *dir;
+  char *p;
+
+  if (file == NULL) {
+    dir = getenv("XDG_RUNTIME_DIR");
+    if (dir == NULL || *dir == '\0')
+      return XDO_ERROR;
+
+    /* One file per display, since each may have its own keymap. */
+    cache->file = malloc(strlen(dir) + strlen(DisplayString(xdo->xdpy))
+                         + sizeof("/xdo-keymap-"));
+    sprintf(cache->file, "%s/xdo-keymap-", dir);
+    p = cache->file + strlen(cache->file);
+    strcpy(p, DisplayString(xdo->xdpy));
+    for (; *p != '\0'; p++) {
+      if (*p == '/')
+        *p = '_';
+    }
+  } else {
+    free(cache->file);
+    cache->file = strdup(file);
+  }
+
+  return XDO_SUCCESS;
+}
+
+/* Build the charcode map through Xlib's XKB calls, one keysym at a
+ * time. */
+static void _xdo_populate_charcode_map_xlib(xdo_t *xdo) {
   int keycodes_length = 0;
   int idx = 0;
   int keycode, group, groups, level, modmask, num_map;
 
-  XDisplayKeycodes(xdo->xdpy, &(xdo->keycode_low), &(xdo->keycode_high));
   XModifierKeymap *modmap = XGetModifierMapping(xdo->xdpy);
   KeySym *keysyms = XGetKeyboardMapping(xdo->xdpy, xdo->keycode_low,
                                         xdo->keycode_high - xdo->keycode_low + 1,
@@ -1384,6 +2323,646 @@ static void _xdo_populate_charcode_map(xdo_t *xdo) {
   XFreeModifiermap(modmap);
 }
 
+#ifdef HAVE_XKBCOMMON_X11
+/* Build the charcode map from the whole keymap, fetched at once and
+ * compiled by xkbcommon-x11, rather than keysym by keysym. The entries
+ * come out in the same order as from the Xlib version. Returns False if
+ * the server's XKB isn't usable this way, so the caller can fall back. */
+static int _xdo_populate_charcode_map_xkbcommon(xdo_t *xdo) {
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  xcb_get_keyboard_mapping_cookie_t keyboard_cookie;
+  xcb_get_keyboard_mapping_reply_t *keyboard_reply;
+  xcb_get_modifier_mapping_cookie_t modmap_cookie;
+  xcb_get_modifier_mapping_reply_t *modmap_reply;
+  XModifierKeymap modmap;
+  struct xkb_context *context;
+  struct xkb_keymap *keymap = NULL;
+  int32_t device;
+  xkb_keycode_t keycode;
+  xkb_layout_index_t group, groups;
+  xkb_level_index_t level, levels;
+  xkb_mod_mask_t masks[8];
+  const xkb_keysym_t *syms;
+  int keycodes_length = 0;
+  int idx = 0;
+  size_t nmasks, i;
+  int modmask;
+
+  /* Ask for the core keyboard and modifier mappings first, so the replies
+   * are on their way while the keymap is fetched. */
+  keyboard_cookie = xcb_get_keyboard_mapping(xcb, xdo->keycode_low,
+      xdo->keycode_high - xdo->keycode_low + 1);
+  modmap_cookie = xcb_get_modifier_mapping(xcb);
+
+  context = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES
+                            | XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+  if (context != NULL
+      && xkb_x11_setup_xkb_extension(xcb, XKB_X11_MIN_MAJOR_XKB_VERSION,
+                                     XKB_X11_MIN_MINOR_XKB_VERSION,
+                                     XKB_X11_SETUP_XKB_EXTENSION_NO_FLAGS,
+                                     NULL, NULL, NULL, NULL)
+      && (device = xkb_x11_get_core_keyboard_device_id(xcb)) != -1) {
+    keymap = xkb_x11_keymap_new_from_device(context, xcb, device,
+                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
+  }
+
+  keyboard_reply = xcb_get_keyboard_mapping_reply(xcb, keyboard_cookie, NULL);
+  modmap_reply = xcb_get_modifier_mapping_reply(xcb, modmap_cookie, NULL);
+  if (keymap == NULL || keyboard_reply == NULL || modmap_reply == NULL) {
+    _xdo_debug(xdo, "xkbcommon-x11 keymap unavailable, using Xlib");
+    if (keymap != NULL)
+      xkb_keymap_unref(keymap);
+    free(keyboard_reply);
+    free(modmap_reply);
+    if (context != NULL)
+      xkb_context_unref(context);
+    return False;
+  }
+
+  modmap.max_keypermod = modmap_reply->keycodes_per_modifier;
+  modmap.modifiermap = xcb_get_modifier_mapping_keycodes(modmap_reply);
+
+  /* The width of the core keyboard mapping, as XGetKeyboardMapping
+   * reports it to the Xlib version. */
+  xdo->keysyms_per_keycode = keyboard_reply->keysyms_per_keycode;
+  free(keyboard_reply);
+
+  for (keycode = xdo->keycode_low; keycode <= (xkb_keycode_t)xdo->keycode_high;
+       keycode++) {
+    groups = xkb_keymap_num_layouts_for_key(keymap, keycode);
+    for (group = 0; group < groups; group++)
+      keycodes_length += xkb_keymap_num_levels_for_key(keymap, keycode, group);
+  }
+
+  xdo->charcodes = calloc(keycodes_length ? keycodes_length : 1,
+                          sizeof(charcodemap_t));
+
+  for (keycode = xdo->keycode_low; keycode <= (xkb_keycode_t)xdo->keycode_high;
+       keycode++) {
+    groups = xkb_keymap_num_layouts_for_key(keymap, keycode);
+    for (group = 0; group < groups; group++) {
+      levels = xkb_keymap_num_levels_for_key(keymap, keycode, group);
+      for (level = 0; level < levels; level++) {
+        KeySym keysym = NoSymbol;
+
+        if (xkb_keymap_key_get_syms_by_level(keymap, keycode, group, level,
+                                             &syms) > 0)
+          keysym = syms[0];
+
+        /* The same rule as the Xlib version: the modifiers of the key
+         * type's first map entry for this level, or none if it has no
+         * entry. xkbcommon puts an empty mask first for level 0 when the
+         * type has no entry for it, which isn't one of the type's entries,
+         * so skip that. The low 8 bits are the real modifiers, in the same
+         * order as the core protocol's. */
+        nmasks = xkb_keymap_key_get_mods_for_level(keymap, keycode, group,
+                                                   level, masks, 8);
+        i = 0;
+        if (level == 0 && nmasks > 0 && masks[0] == 0)
+          i = 1;
+        modmask = (i < nmasks) ? (masks[i] & 0xFF) : 0;
+
+        xdo->charcodes[idx].key = _keysym_to_char(keysym);
+        xdo->charcodes[idx].code = keycode;
+        xdo->charcodes[idx].group = group;
+        xdo->charcodes[idx].modmask = modmask | _xdo_query_keycode_to_modifier(&modmap, keycode);
+        xdo->charcodes[idx].symbol = keysym;
+
+        idx++;
+      }
+    }
+  }
+  xdo->charcodes_len = idx;
+
+  xkb_keymap_unref(keymap);
+  xkb_context_unref(context);
+  free(modmap_reply);
+  return True;
+}
+#endif
+
+static void _xdo_index_charcode_map(xdo_t *xdo) {
+  struct xdo_charcode_index *index;
+  unsigned int size = 64;
+  int i;
+
+  _xdo_free_charcode_index(xdo);
+  index = calloc(1, sizeof(*index));
+
+  /* At most half full, so probe sequences stay short. */
+  while (size < (unsigned int)xdo->charcodes_len * 2)
+    size *= 2;
+
+  index->mask = size - 1;
+  index->chars = malloc(size * sizeof(int));
+  index->keysyms = malloc(size * sizeof(int));
+  memset(index->chars, -1, size * sizeof(int));
+  memset(index->keysyms, -1, size * sizeof(int));
+  memset(index->latin_chars, -1, sizeof(index->latin_chars));
+  memset(index->latin_keysyms, -1, sizeof(index->latin_keysyms));
+
+  /* Only the first entry for a character or keysym goes in, since that is
+   * the one a scan would have found. */
+  for (i = 0; i < xdo->charcodes_len; i++) {
+    wchar_t key = xdo->charcodes[i].key;
+    KeySym keysym = xdo->charcodes[i].symbol;
+    unsigned int slot;
+
+    if (key >= 0 && key < CHARCODE_LATIN_SIZE) {
+      if (index->latin_chars[key] == -1)
+        index->latin_chars[key] = i;
+    } else {
+      slot = _charcode_hash(key) & index->mask;
+      while (index->chars[slot] != -1
+             && xdo->charcodes[index->chars[slot]].key != key)
+        slot = (slot + 1) & index->mask;
+      if (index->chars[slot] == -1)
+        index->chars[slot] = i;
+    }
+
+    if (keysym < CHARCODE_LATIN_SIZE) {
+      if (index->latin_keysyms[keysym] == -1)
+        index->latin_keysyms[keysym] = i;
+    } else {
+      slot = _charcode_hash(keysym) & index->mask;
+      while (index->keysyms[slot] != -1
+             && xdo->charcodes[index->keysyms[slot]].symbol != keysym)
+        slot = (slot + 1) & index->mask;
+      if (index->keysyms[slot] == -1)
+        index->keysyms[slot] = i;
+    }
+  }
+
+  xdo->charcode_index = index;
+}
+
+static void _xdo_free_charcode_index(xdo_t *xdo) {
+  if (xdo->charcode_index == NULL)
+    return;
+
+  if (!xdo->charcode_index->mapped) {
+    free(xdo->charcode_index->chars);
+    free(xdo->charcode_index->keysyms);
+  }
+  free(xdo->charcode_index);
+  xdo->charcode_index = NULL;
+}
+
+static int _xdo_charcode_index_of_char(const xdo_t *xdo, wchar_t key) {
+  const struct xdo_charcode_index *index;
+  unsigned int slot;
+
+  _xdo_need_charcode_map(xdo);
+  index = xdo->charcode_index;
+
+  if (key >= 0 && key < CHARCODE_LATIN_SIZE)
+    return index->latin_chars[key];
+
+  slot = _charcode_hash(key) & index->mask;
+  while (index->chars[slot] != -1) {
+    if (xdo->charcodes[index->chars[slot]].key == key)
+      return index->chars[slot];
+    slot = (slot + 1) & index->mask;
+  }
+
+  return -1;
+}
+
+static int _xdo_charcode_index_of_keysym(const xdo_t *xdo, KeySym keysym) {
+  const struct xdo_charcode_index *index;
+  unsigned int slot;
+
+  _xdo_need_charcode_map(xdo);
+  index = xdo->charcode_index;
+
+  if (keysym < CHARCODE_LATIN_SIZE)
+    return index->latin_keysyms[keysym];
+
+  slot = _charcode_hash(keysym) & index->mask;
+  while (index->keysyms[slot] != -1) {
+    if (xdo->charcodes[index->keysyms[slot]].symbol == keysym)
+      return index->keysyms[slot];
+    slot = (slot + 1) & index->mask;
+  }
+
+  return -1;
+}
+
+/* Bring the list of free keycodes up to date, reading the keyboard mapping
+ * again if it changed since it was last read. */
+static void _xdo_update_free_keycodes(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  KeySym *keysyms;
+  int keysyms_per_keycode = 0;
+  int count = xdo->keycode_high - xdo->keycode_low + 1;
+  int i, j;
+
+  _xdo_check_mapping_notify(xdo);
+
+  if (cache->valid)
+    return;
+
+  /* Our own bindings would make those keycodes look taken. */
+  _xdo_restore_keycode_bindings(xdo);
+
+  keysyms = XGetKeyboardMapping(xdo->xdpy, xdo->keycode_low, count,
+                                &keysyms_per_keycode);
+
+  free(cache->keycodes);
+  free(cache->bound);
+  free(cache->dirty);
+  free(cache->last_used);
+  cache->keycodes = calloc(count, sizeof(int));
+  cache->bound = calloc(count, sizeof(KeySym));
+  cache->dirty = calloc(count, sizeof(int));
+  cache->last_used = calloc(count, sizeof(unsigned long));
+  cache->nkeycodes = 0;
+
+  for (i = 0; keysyms != NULL && i < count; i++) {
+    int key_is_empty = 1;
+
+    for (j = 0; j < keysyms_per_keycode; j++) {
+      if (keysyms[i * keysyms_per_keycode + j] != NoSymbol) {
+        key_is_empty = 0;
+        break;
+      }
+    }
+
+    if (key_is_empty)
+      cache->keycodes[cache->nkeycodes++] =
+        xdo->keycode_low + i;
+  }
+
+  if (keysyms != NULL)
+    XFree(keysyms);
+  cache->valid = True;
+}
+
+/* Returns the free keycode that keysym is (or will be) bound to, binding
+ * the least recently used one if need be, or 0 if every free keycode was
+ * used at or after pin or keysym is NoSymbol. The change is only sent to the server by
+ * _xdo_flush_keycode_bindings. */
+static int _xdo_bind_keysym(const xdo_t *xdo, KeySym keysym,
+                            unsigned long pin) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  int i, lru = -1;
+
+  if (keysym == NoSymbol)
+    return 0;
+
+  for (i = 0; i < cache->nkeycodes; i++) {
+    if (cache->bound[i] == keysym) {
+      cache->last_used[i] = cache->clock;
+      return cache->keycodes[i];
+    }
+
+    if (cache->last_used[i] < pin
+        && (lru == -1
+            || cache->last_used[i] < cache->last_used[lru]))
+      lru = i;
+  }
+
+  if (lru == -1)
+    return 0;
+
+  _xdo_debug(xdo, "Mapping sym %lu to %d", keysym,
+             cache->keycodes[lru]);
+  cache->bound[lru] = keysym;
+  cache->dirty[lru] = True;
+  cache->last_used[lru] = cache->clock;
+  return cache->keycodes[lru];
+}
+
+/* Say why a key that needed binding isn't being sent. */
+static void _xdo_report_unbound_keysym(KeySym keysym) {
+  const char *name = XKeysymToString(keysym);
+
+  if (keysym == NoSymbol || name == NULL)
+    fprintf(stderr, "A key has no keysym to bind, skipping.\n");
+  else
+    fprintf(stderr, "No spare keycode to bind keysym '%s' to, skipping.\n",
+            name);
+}
+
+/* Send the binding changes not sent yet, one request for each run of
+ * consecutive keycodes. Returns True if anything was sent. */
+static int _xdo_flush_keycode_bindings(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  int start, end, sent = False;
+
+  for (start = 0; start < cache->nkeycodes; start = end) {
+    end = start + 1;
+
+    if (!cache->dirty[start])
+      continue;
+
+    /* The free keycodes are in order, so a run of them is contiguous if
+     * the keycodes are too. Unchanged ones in the run go out again as they
+     * are. */
+    while (end < cache->nkeycodes
+           && cache->keycodes[end] == cache->keycodes[end - 1] + 1)
+      end++;
+    while (!cache->dirty[end - 1])
+      end--;
+
+    XChangeKeyboardMapping(xdo->xdpy, cache->keycodes[start], 1,
+                           &cache->bound[start], end - start);
+    cache->own_changes++;
+    memset(&cache->dirty[start], 0, (end - start) * sizeof(int));
+    sent = True;
+  }
+
+  return sent;
+}
+
+/* Unbind every keycode bound by _xdo_bind_keysym. */
+static void _xdo_restore_keycode_bindings(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  int i;
+
+  for (i = 0; i < cache->nkeycodes; i++) {
+    if (cache->bound[i] != NoSymbol) {
+      cache->bound[i] = NoSymbol;
+      cache->dirty[i] = True;
+    }
+    cache->last_used[i] = 0;
+  }
+
+  if (_xdo_flush_keycode_bindings(xdo))
+    _xdo_debug(xdo, "Reverted scratch keycodes");
+}
+
+/* Keep keycode bindings around until the matching release, so that typing
+ * the same characters again reuses them. Holds nest. */
+static void _xdo_hold_keycode_bindings(const xdo_t *xdo) {
+  xdo->keymap_cache->holds++;
+}
+
+static void _xdo_release_keycode_bindings(const xdo_t *xdo) {
+  if (--xdo->keymap_cache->holds == 0) {
+    _xdo_restore_keycode_bindings(xdo);
+    _xdo_restore_key_group(xdo);
+    _xdo_forget_focus(xdo);
+  }
+}
+
+/* Lock the keyboard group for a key sent with XTest. Asking for the current
+ * group costs a round trip, so it is only done for the first key while the
+ * bindings are held; after that we know what we locked it to. */
+static void _xdo_lock_key_group(const xdo_t *xdo, int group) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+
+  if (!cache->group_valid) {
+    XkbStateRec state;
+    XkbGetState(xdo->xdpy, XkbUseCoreKbd, &state);
+    cache->group = cache->original_group = state.group;
+    cache->group_valid = True;
+  }
+
+  if (group != cache->group) {
+    XkbLockGroup(xdo->xdpy, XkbUseCoreKbd, group);
+    cache->group = group;
+  }
+}
+
+/* Put back the group from before the first key, once the last hold is
+ * released. */
+static void _xdo_restore_key_group(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+
+  if (cache->group_valid && cache->group != cache->original_group)
+    XkbLockGroup(xdo->xdpy, XkbUseCoreKbd, cache->original_group);
+  cache->group_valid = False;
+}
+
+/* Take MappingNotify events off the queue. If another client changed the
+ * keyboard or modifier mapping, mark the list of free keycodes stale and
+ * drop the charcode map, so the next lookup builds it again. */
+static void _xdo_check_mapping_notify(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  XEvent event;
+  int i;
+
+  while (XCheckTypedEvent(xdo->xdpy, MappingNotify, &event)) {
+    XMappingEvent *mapping = &event.xmapping;
+    int ours = False;
+
+    XRefreshKeyboardMapping(mapping);
+
+    if (mapping->request == MappingModifier) {
+      /* The charcode map has the modifier keys' own modifiers in it. */
+      cache->modifiers_valid = False;
+      _xdo_free_charcode_map((xdo_t *)xdo);
+    }
+
+    if (mapping->request != MappingKeyboard)
+      continue;
+
+    /* A change to nothing but free keycodes is most likely our own. */
+    if (cache->own_changes > 0) {
+      for (i = 0; i < cache->nkeycodes; i++) {
+        if (cache->keycodes[i] == mapping->first_keycode)
+          break;
+      }
+      ours = (i + mapping->count <= cache->nkeycodes
+              && cache->keycodes[i + mapping->count - 1]
+                 == mapping->first_keycode + mapping->count - 1);
+    }
+
+    if (ours) {
+      cache->own_changes--;
+    } else {
+      _xdo_debug(xdo, "Keyboard mapping changed, keycodes %d to %d",
+                 mapping->first_keycode,
+                 mapping->first_keycode + mapping->count - 1);
+      cache->valid = False;
+      _xdo_free_charcode_map((xdo_t *)xdo);
+    }
+  }
+}
+
+static void _xdo_update_modifier_keycodes(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  XModifierKeymap *modifiers;
+  int mod_index, mod_key;
+
+  if (cache->modifiers_valid)
+    return;
+
+  modifiers = XGetModifierMapping(xdo->xdpy);
+  for (mod_index = ShiftMapIndex; mod_index <= Mod5MapIndex; mod_index++) {
+    cache->modifiers[mod_index] = 0;
+    for (mod_key = 0; mod_key < modifiers->max_keypermod; mod_key++) {
+      KeyCode keycode =
+        modifiers->modifiermap[mod_index * modifiers->max_keypermod + mod_key];
+      if (keycode) {
+        cache->modifiers[mod_index] = keycode;
+        break;
+      }
+    }
+  }
+
+  XFreeModifiermap(modifiers);
+  cache->modifiers_valid = True;
+}
+
+/* XTest is used if the keys are for the focused window, since that is the
+ * one that would get them anyway; otherwise they're sent with XSendEvent.
+ *
+ * Asking costs a round trip, so the answer is kept while the keycode
+ * bindings are held (for one xdo_enter_text_window or keysequence), and
+ * past that if focus tracking is on. */
+static int _xdo_use_xtest(const xdo_t *xdo, Window window) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  Window focuswin = 0;
+
+  if (window == CURRENTWINDOW)
+    return True;
+
+  if (cache->focus_tracking)
+    _xdo_check_focus_change(xdo, window);
+
+  if (cache->focus_valid && cache->focus_window == window)
+    return cache->focus_xtest;
+
+  xdo_get_focused_window(xdo, &focuswin);
+  cache->focus_window = window;
+  cache->focus_xtest = (focuswin == window);
+  cache->focus_valid = (cache->holds > 0 || cache->focus_tracking);
+  return cache->focus_xtest;
+}
+
+/* Ask again next time, unless focus tracking will say when to. */
+static void _xdo_forget_focus(const xdo_t *xdo) {
+  if (!xdo->keymap_cache->focus_tracking)
+    xdo->keymap_cache->focus_valid = False;
+}
+
+/* Start listening for focus changes on window if that isn't the one being
+ * listened to, and forget whether it has the focus if it gained or lost
+ * it since last time. */
+static void _xdo_check_focus_change(const xdo_t *xdo, Window window) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  XWindowAttributes attr;
+  XEvent event;
+
+  if (window != cache->focus_window) {
+    _xdo_stop_focus_listening(xdo);
+    cache->focus_valid = False;
+
+    /* Leave the event mask alone if something else already selected
+     * FocusChangeMask; the events come to us all the same. */
+    if (XGetWindowAttributes(xdo->xdpy, window, &attr)
+        && !(attr.your_event_mask & FocusChangeMask)) {
+      XSelectInput(xdo->xdpy, window, attr.your_event_mask | FocusChangeMask);
+      cache->focus_listening = window;
+    }
+    return;
+  }
+
+  while (XCheckTypedWindowEvent(xdo->xdpy, window, FocusIn, &event)
+         || XCheckTypedWindowEvent(xdo->xdpy, window, FocusOut, &event)) {
+    cache->focus_valid = False;
+  }
+}
+
+static void _xdo_stop_focus_listening(const xdo_t *xdo) {
+  struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  XWindowAttributes attr;
+  XEvent event;
+  Window window = cache->focus_listening;
+
+  if (window == None)
+    return;
+
+  cache->focus_listening = None;
+
+  /* Only take our bit back out, the rest may have changed since. */
+  if (XGetWindowAttributes(xdo->xdpy, window, &attr)) {
+    XSelectInput(xdo->xdpy, window, attr.your_event_mask & ~FocusChangeMask);
+  }
+
+  while (XCheckTypedWindowEvent(xdo->xdpy, window, FocusIn, &event)
+         || XCheckTypedWindowEvent(xdo->xdpy, window, FocusOut, &event)) {
+    /* Nothing; these were only for us. */
+  }
+}
+
+/* Decode the UTF-8 character at the start of bytes into ch. Returns how
+ * many bytes it took, (size_t)-2 if bytes end partway through it, or
+ * (size_t)-1 if it isn't valid UTF-8: overlong forms, surrogates and code
+ * points past U+10FFFF are all rejected. */
+static size_t _xdo_utf8_decode(const unsigned char *bytes, size_t len,
+                               wchar_t *ch) {
+  unsigned char c = bytes[0];
+  unsigned long code, min;
+  size_t n, i;
+
+  if (c < 0x80) {
+    *ch = c;
+    return 1;
+  } else if (c >= 0xC2 && c <= 0xDF) {
+    n = 2;
+    code = c & 0x1F;
+    min = 0x80;
+  } else if ((c & 0xF0) == 0xE0) {
+    n = 3;
+    code = c & 0x0F;
+    min = 0x800;
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    n = 4;
+    code = c & 0x07;
+    min = 0x10000;
+  } else {
+    return (size_t)-1;
+  }
+
+  for (i = 1; i < n; i++) {
+    if (i >= len)
+      return (size_t)-2;
+    if ((bytes[i] & 0xC0) != 0x80)
+      return (size_t)-1;
+    code = (code << 6) | (bytes[i] & 0x3F);
+  }
+
+  if (code < min || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+    return (size_t)-1;
+
+  *ch = (wchar_t)code;
+  return n;
+}
+
+/* How many bytes at the start of bytes are ASCII. Checks a word at a time
+ * while it can, since a word with no high bit set is all ASCII. */
+static size_t _xdo_utf8_ascii_run(const char *bytes, size_t len) {
+  const unsigned long high_bits = (unsigned long)-1 / 0xFF * 0x80;
+  unsigned long word;
+  size_t n = 0;
+
+  while (len - n >= sizeof(word)) {
+    memcpy(&word, bytes + n, sizeof(word));
+    if (word & high_bits)
+      break;
+    n += sizeof(word);
+  }
+
+  while (n < len && !(bytes[n] & 0x80))
+    n++;
+
+  return n;
+}
+
+/* Unicode keysyms are 0x1000000 + the code point, and characters of one
+ * script sit close together, so mix the bits before masking. */
+static unsigned int _charcode_hash(unsigned long value) {
+  unsigned int hash = (unsigned int)(value ^ (value >> 24));
+
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3b;
+  hash ^= hash >> 16;
+  return hash;
+}
+
 /* context-free functions */
 wchar_t _keysym_to_char(KeySym keysym) {
   return (wchar_t)xkb_keysym_to_utf32(keysym);
@@ -1392,9 +2971,8 @@ wchar_t _keysym_to_char(KeySym keysym) {
 int _xdo_send_keysequence_window_to_keycode_list(const xdo_t *xdo, const char *keyseq,
                                      charcodemap_t **keys, int *nkeys) {
   char *tokctx = NULL;
-  const char *tok = NULL;
+  const char *tok = NULL, *alias;
   char *keyseq_copy = NULL, *strptr = NULL;
-  int i = 0;
   int any_failed = 0;
 
   /* Array of keys to press, in order given by keyseq */
@@ -1405,6 +2983,8 @@ int _xdo_send_keysequence_window_to_keycode_list(const xdo_t *xdo, const char *k
     return False;
   }
 
+  _xdo_check_mapping_notify(xdo);
+
   *nkeys = 0;
   *keys = calloc(keys_size, sizeof(charcodemap_t));
   keyseq_copy = strptr = strdup(keyseq);
@@ -1416,10 +2996,8 @@ int _xdo_send_keysequence_window_to_keycode_list(const xdo_t *xdo, const char *k
       strptr = NULL;
 
     /* Check if 'tok' (string keysym) is an alias to another key */
-    /* symbol_map comes from xdo.util */
-    for (i = 0; symbol_map[i] != NULL; i+=2)
-      if (!strcasecmp(tok, symbol_map[i]))
-        tok = symbol_map[i + 1];
+    if ((alias = _xdo_symbol_alias(tok)) != NULL)
+      tok = alias;
 
     sym = XStringToKeysym(tok);
     if (sym == NoSymbol) {
@@ -1447,7 +3025,7 @@ int _xdo_send_keysequence_window_to_keycode_list(const xdo_t *xdo, const char *k
     (*nkeys)++;
     if (*nkeys == keys_size) {
       keys_size *= 2;
-      *keys = realloc(*keys, keys_size * sizeof(KeyCode));
+      *keys = realloc(*keys, keys_size * sizeof(charcodemap_t));
     }
   }
 
@@ -1455,6 +3033,49 @@ int _xdo_send_keysequence_window_to_keycode_list(const xdo_t *xdo, const char *k
   return any_failed == 0;
 }
 
+/* The aliases in symbol_map (from xdo_util.h), hashed by name ignoring
+ * case. Filled in the first time a key sequence is parsed. */
+#define SYMBOL_ALIAS_SLOTS 32
+
+static const char *symbol_aliases[SYMBOL_ALIAS_SLOTS][2];
+static int symbol_aliases_filled = False;
+
+/* Returns the keysym name an alias like "ctrl" stands for, or NULL. */
+static const char *_xdo_symbol_alias(const char *name) {
+  unsigned int slot;
+  int i;
+
+  if (!symbol_aliases_filled) {
+    for (i = 0; symbol_map[i] != NULL; i += 2) {
+      slot = _symbol_alias_hash(symbol_map[i]) & (SYMBOL_ALIAS_SLOTS - 1);
+      while (symbol_aliases[slot][0] != NULL)
+        slot = (slot + 1) & (SYMBOL_ALIAS_SLOTS - 1);
+
+      symbol_aliases[slot][0] = symbol_map[i];
+      symbol_aliases[slot][1] = symbol_map[i + 1];
+    }
+    symbol_aliases_filled = True;
+  }
+
+  for (slot = _symbol_alias_hash(name) & (SYMBOL_ALIAS_SLOTS - 1);
+       symbol_aliases[slot][0] != NULL;
+       slot = (slot + 1) & (SYMBOL_ALIAS_SLOTS - 1)) {
+    if (!strcasecmp(name, symbol_aliases[slot][0]))
+      return symbol_aliases[slot][1];
+  }
+
+  return NULL;
+}
+
+static unsigned int _symbol_alias_hash(const char *name) {
+  unsigned int hash = 5381;
+
+  while (*name != '\0')
+    hash = hash * 33 + tolower((unsigned char)*name++);
+
+  return hash;
+}
+
 int _is_success(const char *funcname, int code, const xdo_t *xdo) {
   /* Nonzero is failure. */
   if (code != 0 && !xdo->quiet)
@@ -1557,34 +3178,19 @@ void _xdo_init_xkeyevent(const xdo_t *xdo, XKeyEvent *xk) {
   xk->x = xk->y = xk->x_root = xk->y_root = 1;
 }
 
+/* Queue the events for one key. The caller takes care of the keyboard
+ * group, flushing and delays; see xdo_send_keysequence_window_list_do. */
 void _xdo_send_key(const xdo_t *xdo, Window window, charcodemap_t *key,
-                          int modstate, int is_press, useconds_t delay) {
+                          int modstate, int is_press, int use_xtest) {
   /* Properly ensure the modstate is set by finding a key
    * that activates each bit in the modifier state */
   int mask = modstate | key->modmask;
-  int use_xtest = 0;
 
-  if (window == CURRENTWINDOW) {
-    use_xtest = 1;
-  } else {
-    Window focuswin = 0;
-    xdo_get_focused_window(xdo, &focuswin);
-    if (focuswin == window) {
-      use_xtest = 1;
-    }
-  }
   if (use_xtest) {
-    //printf("XTEST: Sending key %d %s\n", key->code, is_press ? "down" : "up");
-    XkbStateRec state;
-    XkbGetState(xdo->xdpy, XkbUseCoreKbd, &state);
-    int current_group = state.group;
-    XkbLockGroup(xdo->xdpy, XkbUseCoreKbd, key->group);
     if (mask)
       _xdo_send_modifier(xdo, mask, is_press);
     //printf("XTEST: Sending key %d %s %x %d\n", key->code, is_press ? "down" : "up", key->modmask, key->group);
     XTestFakeKeyEvent(xdo->xdpy, key->code, is_press, CurrentTime);
-    XkbLockGroup(xdo->xdpy, XkbUseCoreKbd, current_group);
-    XSync(xdo->xdpy, False);
   } else {
     /* Since key events have 'state' (shift, etc) in the event, we don't
      * need to worry about key press ordering. */
@@ -1596,12 +3202,6 @@ void _xdo_send_key(const xdo_t *xdo, Window window, charcodemap_t *key,
     xk.type = (is_press ? KeyPress : KeyRelease);
     XSendEvent(xdo->xdpy, xk.window, True, KeyPressMask, (XEvent *)&xk);
   }
-
-  /* Skipping the usleep if delay is 0 is much faster than calling usleep(0) */
-  XFlush(xdo->xdpy);
-  if (delay > 0) {
-    usleep(delay);
-  }
 }
 
 int _xdo_query_keycode_to_modifier(XModifierKeymap *modmap, KeyCode keycode) {
@@ -1630,23 +3230,16 @@ int _xdo_query_keycode_to_modifier(XModifierKeymap *modmap, KeyCode keycode) {
 }
 
 void _xdo_send_modifier(const xdo_t *xdo, int modmask, int is_press) {
-  XModifierKeymap *modifiers = XGetModifierMapping(xdo->xdpy);
-  int mod_index, mod_key, keycode;
+  const struct xdo_keymap_cache *cache = xdo->keymap_cache;
+  int mod_index;
+
+  _xdo_update_modifier_keycodes(xdo);
 
   for (mod_index = ShiftMapIndex; mod_index <= Mod5MapIndex; mod_index++) {
-    if (modmask & (1 << mod_index)) {
-      for (mod_key = 0; mod_key < modifiers->max_keypermod; mod_key++) {
-        keycode = modifiers->modifiermap[mod_index * modifiers->max_keypermod + mod_key];
-        if (keycode) {
-          XTestFakeKeyEvent(xdo->xdpy, keycode, is_press, CurrentTime);
-          XSync(xdo->xdpy, False);
-          break;
-        }
-      }
-    }
+    if ((modmask & (1 << mod_index)) && cache->modifiers[mod_index])
+      XTestFakeKeyEvent(xdo->xdpy, cache->modifiers[mod_index], is_press,
+                        CurrentTime);
   }
-
-  XFreeModifiermap(modifiers);
 }
 
 int xdo_get_active_modifiers(const xdo_t *xdo, charcodemap_t **keys,
@@ -1798,35 +3391,37 @@ int xdo_get_pid_window(const xdo_t *xdo, Window window) {
   return window_pid;
 }
 
-int xdo_wait_for_mouse_move_from(const xdo_t *xdo, int origin_x, int origin_y) {
+static int _wait_mouse_from(const xdo_t *xdo, const wait_condition_t *cond) {
   int x, y;
-  int ret = 0;
-  int tries = MAX_TRIES;
-
-  ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
-  while (tries > 0 &&
-         (x == origin_x && y == origin_y)) {
-    usleep(30000);
-    ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
-    tries--;
-  }
 
-  return ret;
+  if (xdo_get_mouse_location(xdo, &x, &y, NULL) != XDO_SUCCESS)
+    return -1;
+  return !(x == cond->x && y == cond->y);
 }
 
-int xdo_wait_for_mouse_move_to(const xdo_t *xdo, int dest_x, int dest_y) {
+static int _wait_mouse_to(const xdo_t *xdo, const wait_condition_t *cond) {
   int x, y;
-  int ret = 0;
-  int tries = MAX_TRIES;
 
-  ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
-  while (tries > 0 && (x != dest_x && y != dest_y)) {
-    usleep(30000);
-    ret = xdo_get_mouse_location(xdo, &x, &y, NULL);
-    tries--;
-  }
+  if (xdo_get_mouse_location(xdo, &x, &y, NULL) != XDO_SUCCESS)
+    return -1;
+  return !(x != cond->x && y != cond->y);
+}
 
-  return ret;
+/* Motion events reach the root only while the pointer isn't over a window
+ * some other client takes motion events on, so the mouse waits also look
+ * again every 30ms, as often as they used to. */
+int xdo_wait_for_mouse_move_from(const xdo_t *xdo, int origin_x, int origin_y) {
+  wait_condition_t cond = { None, 0, origin_x, origin_y, 0, 0 };
+
+  return _xdo_wait(xdo, XDefaultRootWindow(xdo->xdpy), PointerMotionMask, 30,
+                   _wait_mouse_from, &cond);
+}
+
+int xdo_wait_for_mouse_move_to(const xdo_t *xdo, int dest_x, int dest_y) {
+  wait_condition_t cond = { None, 0, dest_x, dest_y, 0, 0 };
+
+  return _xdo_wait(xdo, XDefaultRootWindow(xdo->xdpy), PointerMotionMask, 30,
+                   _wait_mouse_to, &cond);
 }
 
 int xdo_get_desktop_viewport(const xdo_t *xdo, int *x_ret, int *y_ret) {
@@ -73,6 +73,15 @@ typedef enum {
   XDO_FEATURE_XTEST, /** Is XTest available? */
 } XDO_FEATURES;
 
+/** @internal Window index, see xdo_enable_window_index */
+struct xdo_window_index;
+
+/** @internal Lookup tables over the charcodes array */
+struct xdo_charcode_index;
+
+/** @internal What libxdo keeps of the keyboard and modifier mappings */
+struct xdo_keymap_cache;
+
 /**
  * The main context.
  */
@@ -84,7 +93,7 @@ typedef struct xdo {
   /** The display name, if any. NULL if not specified. */
   char *display_name;
 
-  /** @internal Array of known keys/characters */
+  /** @internal Array of known keys/characters, NULL until first needed */
   charcodemap_t *charcodes;
 
   /** @internal Length of charcodes array */
@@ -111,6 +120,22 @@ typedef struct xdo {
   /** Feature flags, such as XDO_FEATURE_XTEST, etc... */
   int features_mask;
 
+  /** @internal Window index, NULL unless enabled */
+  struct xdo_window_index *window_index;
+
+  /** @internal Lookup tables over charcodes, by character and by keysym */
+  struct xdo_charcode_index *charcode_index;
+
+  /** @internal Free keycodes and modifier keycodes, see xdo.c */
+  struct xdo_keymap_cache *keymap_cache;
+
+  /**
+   * How long the xdo_wait_for_* functions wait, in milliseconds, before
+   * giving up and returning XDO_ERROR. 0 waits for as long as it takes.
+   * xdo_new sets this to 15000.
+   */
+  int wait_timeout;
+
 } xdo_t;
 
 /**
@@ -179,6 +204,31 @@ typedef struct xdo {
  */
 #define SEARCH_HAS_PROPERTY (1UL << 10)
 
+/**
+ * (Search only) Return windows in stacking order, bottom-most first, using
+ * _NET_CLIENT_LIST_STACKING. Only has an effect when the search reads the
+ * client list, see xdo_search_windows.
+ */
+#define SEARCH_STACKING (1UL << 11)
+
+/**
+ * (Search only) When searching more than one screen, search each one on an
+ * xcb connection of its own, in a thread of its own. The threads don't use
+ * Xlib, so XInitThreads is not needed. Results are returned in the same
+ * order as without this flag: the roots, then the top-level windows of
+ * every screen in screen order, and so on down the tree. A screen that
+ * can't have a connection of its own is searched on the Display's.
+ * Ignored while the window index is enabled.
+ */
+#define SEARCH_PARALLEL (1UL << 12)
+
+/**
+ * (Search only) Walk the whole window tree even if the window manager
+ * keeps a client list, so that frames, child windows and override-redirect
+ * windows are searched too. See xdo_search_plan_windows.
+ */
+#define SEARCH_TREE (1UL << 13)
+
 /**
  * (Deprecated) The window search query structure.
  *
@@ -220,6 +270,34 @@ typedef struct xdo_search {
 struct xdo_select;
 typedef struct xdo_select xdo_select_t;
 
+/**
+ * Opaque structure for a compiled window search.
+ *
+ * A search plan is built once from an xdo_search_t, can be run any number of
+ * times, and is freed once. The patterns are only compiled when the plan is
+ * created, not for every window visited.
+ *
+ * @see xdo_search_plan_new
+ */
+struct xdo_search_plan;
+typedef struct xdo_search_plan xdo_search_plan_t;
+
+/**
+ * Called with each window a search finds, as soon as it is found.
+ *
+ * @param window the matching window.
+ * @param data the data pointer given to the search.
+ * @return XDO_SEARCH_CONTINUE to keep searching, XDO_SEARCH_STOP to end the
+ *   search without looking at any more windows.
+ * @see xdo_search_plan_foreach
+ * @see xdo_select_foreach
+ */
+typedef int (*xdo_window_found_t)(const xdo_t *xdo, Window window,
+                                  void *data);
+
+#define XDO_SEARCH_CONTINUE 0
+#define XDO_SEARCH_STOP 1
+
 #define XDO_ERROR 1
 #define XDO_SUCCESS 0
 
@@ -335,19 +413,29 @@ int xdo_get_mouse_location2(const xdo_t *xdo, int *x_ret, int *y_ret,
 
 /**
  * Wait for the mouse to move from a location. This function will block
- * until the condition has been satisfied.
+ * until the condition has been satisfied, or for at most xdo->wait_timeout.
+ *
+ * This still polls: motion events only reach the root window while the
+ * pointer isn't over a window another client takes motion events on, so
+ * besides listening for them it looks at the pointer every 30ms.
  *
  * @param origin_x the X position you expect the mouse to move from
  * @param origin_y the Y position you expect the mouse to move from
+ * @return XDO_ERROR if the mouse hasn't moved within xdo->wait_timeout.
  */
 int xdo_wait_for_mouse_move_from(const xdo_t *xdo, int origin_x, int origin_y);
 
 /**
  * Wait for the mouse to move to a location. This function will block
- * until the condition has been satisfied.
+ * until the condition has been satisfied, or for at most xdo->wait_timeout.
+ *
+ * This still polls: motion events only reach the root window while the
+ * pointer isn't over a window another client takes motion events on, so
+ * besides listening for them it looks at the pointer every 30ms.
  *
  * @param dest_x the X position you expect the mouse to move to
  * @param dest_y the Y position you expect the mouse to move to
+ * @return XDO_ERROR if the mouse isn't there within xdo->wait_timeout.
  */
 int xdo_wait_for_mouse_move_to(const xdo_t *xdo, int dest_x, int dest_y);
 
@@ -384,6 +472,87 @@ int xdo_click_window_multiple(const xdo_t *xdo, Window window, int button,
  */
 int xdo_enter_text_window(const xdo_t *xdo, Window window, const char *string, useconds_t delay);
 
+/**
+ * Opaque structure for text compiled into key events.
+ *
+ * Working out which key types each character is done once, when the text
+ * is added, rather than while typing. Playing the buffer then sends the
+ * events back to back, flushing only where there is a delay to wait out,
+ * which is the fastest way to type a lot of text. A buffer can be played
+ * any number of times, to any window.
+ *
+ * @see xdo_key_buffer_new
+ */
+struct xdo_key_buffer;
+typedef struct xdo_key_buffer xdo_key_buffer_t;
+
+/**
+ * Create an empty key buffer.
+ *
+ * @param delay The delay between keystrokes in microseconds, as for
+ *   xdo_enter_text_window. With 0, the events are sent as fast as the X
+ *   server will take them.
+ * @see xdo_key_buffer_add_text
+ * @see xdo_key_buffer_free
+ */
+xdo_key_buffer_t *xdo_key_buffer_new(const xdo_t *xdo, useconds_t delay);
+
+/**
+ * Add the key presses and releases that type a string to the buffer.
+ *
+ * Characters no key produces are skipped, with a message. The message
+ * prints the character in the encoding of the program's locale, which
+ * libxdo leaves alone; call setlocale(LC_CTYPE, "") to have it readable.
+ *
+ * @param string The string to type, like "Hello world!"
+ * @return XDO_ERROR, leaving the buffer as it was, if the string is not
+ *   valid UTF-8.
+ */
+int xdo_key_buffer_add_text(xdo_key_buffer_t *buffer, const char *string);
+
+/**
+ * Add the key presses and releases for some bytes of text to the buffer.
+ *
+ * This is for text that arrives in pieces, such as from a pipe. The bytes
+ * may end partway through a multibyte character; the rest of it is taken
+ * from the start of the next call.
+ *
+ * @param bytes The text, which does not need to be NUL terminated.
+ * @param len How many bytes of text there are.
+ * @return XDO_ERROR, leaving the buffer as it was, if the bytes are not
+ *   valid UTF-8.
+ */
+int xdo_key_buffer_add_bytes(xdo_key_buffer_t *buffer, const char *bytes,
+                             size_t len);
+
+/**
+ * Mark the end of text added with xdo_key_buffer_add_bytes.
+ *
+ * @return XDO_ERROR, dropping it, if the text ended partway through a
+ *   multibyte character.
+ */
+int xdo_key_buffer_finish(xdo_key_buffer_t *buffer);
+
+/**
+ * Empty the key buffer, keeping its memory for the next text.
+ *
+ * A multibyte character left unfinished by xdo_key_buffer_add_bytes is
+ * kept, too.
+ */
+void xdo_key_buffer_clear(xdo_key_buffer_t *buffer);
+
+/**
+ * Type the contents of a key buffer.
+ *
+ * @param window The window you want to send keystrokes to or CURRENTWINDOW
+ */
+int xdo_key_buffer_play(const xdo_key_buffer_t *buffer, Window window);
+
+/**
+ * Free a key buffer created by xdo_key_buffer_new.
+ */
+void xdo_key_buffer_free(xdo_key_buffer_t *buffer);
+
 /**
  * Send a keysequence to the specified window.
  *
@@ -423,6 +592,79 @@ int xdo_send_keysequence_window_up(const xdo_t *xdo, Window window,
  */
 int xdo_send_keysequence_window_down(const xdo_t *xdo, Window window,
                          const char *keysequence, useconds_t delay);
+
+/**
+ * Opaque structure for a parsed key sequence.
+ *
+ * Parsing a key sequence means looking up each key name and finding the
+ * key for it. Doing that once and sending the result many times saves the
+ * work when the same keys are sent over and over. A key sequence reflects
+ * the keyboard mapping at the time it was made.
+ *
+ * @see xdo_keysequence_new
+ */
+struct xdo_keysequence;
+typedef struct xdo_keysequence xdo_keysequence_t;
+
+/**
+ * Parse a key sequence, in the form xdo_send_keysequence_window takes.
+ *
+ * @param keysequence The string keysequence, like "alt+Return".
+ * @return a new key sequence, or NULL if any of the keys is not valid.
+ * @see xdo_keysequence_send
+ * @see xdo_keysequence_free
+ */
+xdo_keysequence_t *xdo_keysequence_new(const xdo_t *xdo,
+                                       const char *keysequence);
+
+/**
+ * Free a key sequence created by xdo_keysequence_new.
+ */
+void xdo_keysequence_free(xdo_keysequence_t *seq);
+
+/**
+ * Press and release a parsed key sequence.
+ *
+ * @param window The window you want to send the keysequence to or
+ *   CURRENTWINDOW
+ * @param delay The delay between keystrokes in microseconds.
+ * @see xdo_send_keysequence_window
+ */
+int xdo_keysequence_send(const xdo_keysequence_t *seq, Window window,
+                         useconds_t delay);
+
+/**
+ * Send key release (up) events for a parsed key sequence.
+ *
+ * @see xdo_keysequence_send
+ */
+int xdo_keysequence_send_up(const xdo_keysequence_t *seq, Window window,
+                            useconds_t delay);
+
+/**
+ * Send key press (down) events for a parsed key sequence.
+ *
+ * @see xdo_keysequence_send
+ */
+int xdo_keysequence_send_down(const xdo_keysequence_t *seq, Window window,
+                              useconds_t delay);
+
+/**
+ * Keep what libxdo works out while sending keys until the matching
+ * xdo_keysequence_end: keysyms bound to spare keycodes, whether the window
+ * has the input focus, and the keyboard group XTest keys go out in. Sending
+ * key sequences many times in a row then pays for those once rather than
+ * on every send. Calls nest.
+ *
+ * @see xdo_keysequence_end
+ */
+void xdo_keysequence_begin(const xdo_t *xdo);
+
+/**
+ * Undo the spare keycode bindings and put back the keyboard group, if this
+ * ends the outermost xdo_keysequence_begin.
+ */
+void xdo_keysequence_end(const xdo_t *xdo);
   
 /**
  * Send a series of keystrokes.
@@ -439,6 +681,63 @@ int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window,
                             charcodemap_t *keys, int nkeys,
                             int pressed, int *modifier, useconds_t delay);
 
+/**
+ * Reload the keyboard mapping from the X server.
+ *
+ * libxdo reads the keyboard mapping once, the first time it looks up a
+ * key, and keeps a list of the keycodes with nothing bound to them for
+ * typing characters the keyboard doesn't have. That list is refreshed by
+ * itself when a MappingNotify event from another client arrives; libxdo
+ * takes those events off the Display's queue (passing them to
+ * XRefreshKeyboardMapping) whenever it sends keys. Call this after changing
+ * the keyboard mapping yourself, or to pick up a new keyboard layout. The
+ * mapping is read again the next time it is needed.
+ */
+int xdo_refresh_keyboard_mapping(xdo_t *xdo);
+
+/**
+ * Keep the keyboard mapping libxdo builds in a file, for the next process
+ * using the same display to pick up instead of building it again.
+ *
+ * The file is only used if it is intact and the X server's keyboard and
+ * modifier mappings are still the ones it was built from; otherwise it is
+ * rebuilt and written again. Not being able to read or write it is not an error.
+ *
+ * This is also turned on by xdo_new if the XDO_KEYMAP_CACHE environment
+ * variable is set, to the file to use, or to nothing for the default.
+ *
+ * Call this before any key is sent or looked up, since the mapping is
+ * only read once (see xdo_refresh_keyboard_mapping).
+ *
+ * @param file The file to use, or NULL for xdo-keymap-DISPLAY in
+ *   $XDG_RUNTIME_DIR.
+ * @return XDO_ERROR if file is NULL and XDG_RUNTIME_DIR is not set.
+ */
+int xdo_enable_keymap_cache(xdo_t *xdo, const char *file);
+
+/**
+ * Remember whether the window keys are sent to has the input focus.
+ *
+ * Keys for the focused window are sent with XTest, and keys for any other
+ * window with XSendEvent. Finding out which costs a round trip, which
+ * libxdo otherwise pays once per call that sends keys, or once per
+ * character when typing with a delay. With tracking on, libxdo selects
+ * FocusChange events on the window and only asks again after one arrives;
+ * the events are read from the Display's queue whenever keys are sent.
+ *
+ * If you read events from the Display yourself (for example with
+ * XNextEvent), FocusIn and FocusOut events on that window may be missed,
+ * so call xdo_disable_focus_tracking first.
+ *
+ * @see xdo_disable_focus_tracking
+ */
+int xdo_enable_focus_tracking(xdo_t *xdo);
+
+/**
+ * Stop tracking the input focus, and restore the event mask it changed.
+ */
+void xdo_disable_focus_tracking(xdo_t *xdo);
+
 /**
  * Wait for a window to have a specific map state.
  *
@@ -448,16 +747,43 @@ int xdo_send_keysequence_window_list_do(const xdo_t *xdo, Window window,
  *     on top of it)
  *   IsUnviewable - window is mapped but a parent window is unmapped.
  *
+ * This listens for the window's map and visibility events and returns as
+ * soon as the state is right. A parent (like a window manager frame) being
+ * mapped or unmapped sends the window neither, so it also looks again every
+ * 100ms.
+ *
  * @param wid the window you want to wait for.
  * @param map_state the state to wait for.
+ * @return XDO_ERROR if the window doesn't have that state within
+ *   xdo->wait_timeout.
  */
 int xdo_wait_for_window_map_state(const xdo_t *xdo, Window wid, int map_state);
 
 #define SIZE_TO 0
 #define SIZE_FROM 1
+/**
+ * Wait for a window to have, or to stop having, a size.
+ *
+ * @param flags SIZE_USEHINTS if width and height are in size hint units.
+ * @param to_or_from SIZE_TO to wait for the size, SIZE_FROM to wait for
+ *   the window to change from it.
+ * @return XDO_ERROR if the size isn't right within xdo->wait_timeout.
+ */
 int xdo_wait_for_window_size(const xdo_t *xdo, Window window, unsigned int width,
                              unsigned int height, int flags, int to_or_from);
 
+/**
+ * Wait for a window to move from a location, as xdo_get_window_location
+ * reports it. Window managers often put a window somewhere other than
+ * where it was asked to go, so this doesn't wait for any one place.
+ *
+ * @param origin_x the X position you expect the window to move from
+ * @param origin_y the Y position you expect the window to move from
+ * @return XDO_ERROR if the window hasn't moved within xdo->wait_timeout.
+ */
+int xdo_wait_for_window_move_from(const xdo_t *xdo, Window window,
+                                  int origin_x, int origin_y);
+
 /**
  * Move a window to a specific location.
  *
@@ -572,6 +898,7 @@ int xdo_get_focused_window(const xdo_t *xdo, Window *window_ret);
  *
  * @param window The window to wait on
  * @param want_focus If 1, wait for focus. If 0, wait for loss of focus.
+ * @return XDO_ERROR if the focus hasn't changed within xdo->wait_timeout.
  */
 int xdo_wait_for_window_focus(const xdo_t *xdo, Window window, int want_focus);
 
@@ -624,6 +951,8 @@ int xdo_activate_window(const xdo_t *xdo, Window wid);
  *
  * @param window the window to wait on
  * @param active If 1, wait for active. If 0, wait for inactive.
+ * @return XDO_ERROR if the window isn't (or still is) active within
+ *   xdo->wait_timeout.
  */
 int xdo_wait_for_window_active(const xdo_t *xdo, Window window, int active);
 
@@ -862,6 +1191,80 @@ void xdo_select_set_use_client_list(xdo_select_t *selection, int use);
 int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
                       Window **windowlist_ret, unsigned int *nwindows_ret);
 
+/**
+ * Compile a search query into a reusable search plan.
+ *
+ * The plan keeps its own copy of the query, so the xdo_search_t (and its
+ * pattern strings) may be released after this returns.
+ *
+ * @param search the search query.
+ * @return a new plan, or NULL if one of the patterns failed to compile.
+ * @see xdo_search_plan_windows
+ * @see xdo_search_plan_free
+ */
+xdo_search_plan_t *xdo_search_plan_new(const xdo_t *xdo,
+                                       const xdo_search_t *search);
+
+/**
+ * Free a search plan created by xdo_search_plan_new.
+ */
+void xdo_search_plan_free(xdo_search_plan_t *plan);
+
+/**
+ * Search for windows using a compiled search plan.
+ *
+ * When the search has no max_depth (-1) and the window manager lists
+ * _NET_CLIENT_LIST in _NET_SUPPORTED, only the root windows and the client
+ * windows it manages are checked, in client list order. Frames, child
+ * windows and override-redirect windows (menus, tooltips) are then not
+ * found. Otherwise, or with SEARCH_TREE, the whole window tree is walked.
+ *
+ * While the window index is enabled the whole tree is searched from
+ * memory, without asking the server anything, unless SEARCH_STACKING asks
+ * for the window manager's stacking order.
+ *
+ * @param plan the compiled search.
+ * @param windowlist_ret the list of matching windows to return
+ * @param nwindows_ret the number of windows (length of windowlist_ret)
+ * @see xdo_search_plan_new
+ */
+int xdo_search_plan_windows(const xdo_search_plan_t *plan,
+                            Window **windowlist_ret,
+                            unsigned int *nwindows_ret);
+
+/**
+ * Search for windows using a compiled search plan, handing each match to a
+ * callback as soon as it is found rather than collecting a list.
+ *
+ * Windows are found in the same order as xdo_search_plan_windows returns
+ * them, and the search's limit still applies.
+ *
+ * @param plan the compiled search.
+ * @param found called with each matching window.
+ * @param data passed to found.
+ * @see xdo_window_found_t
+ */
+int xdo_search_plan_foreach(const xdo_search_plan_t *plan,
+                            xdo_window_found_t found, void *data);
+
+/**
+ * Wait until a window changes in a way that could give the search plan
+ * a result it didn't have: a window the plan matches is created, mapped,
+ * moved in the tree, or has a property change. Changes to windows that
+ * don't match are taken into the index, but don't end the wait.
+ *
+ * Use this instead of xdo_window_index_wait to wait for a search to have
+ * results, running it again each time this returns.
+ *
+ * @param plan the compiled search.
+ * @param timeout How long to wait, in milliseconds. 0 waits for as long as
+ *   it takes.
+ * @return XDO_ERROR if the window index is not enabled, or nothing changed
+ *   in time.
+ * @see xdo_enable_window_index
+ */
+int xdo_search_plan_wait(const xdo_search_plan_t *plan, int timeout);
+
 /**
  * Select windows using criteria.
  *
@@ -873,6 +1276,86 @@ int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
 int xdo_select_windows(xdo_select_t *selection, Window **windowlist_ret,
                        unsigned int *nwindows_ret);
 
+/**
+ * Select windows using criteria, handing each match to a callback as soon
+ * as it is found rather than collecting a list.
+ *
+ * @param select the selection query.
+ * @param found called with each matching window.
+ * @param data passed to found.
+ * @see xdo_window_found_t
+ */
+int xdo_select_foreach(xdo_select_t *selection, xdo_window_found_t found,
+                       void *data);
+
+/**
+ * The same as xdo_search_plan_wait, for a selection.
+ *
+ * @param selection the selection query.
+ * @param timeout How long to wait, in milliseconds. 0 waits for as long as
+ *   it takes.
+ * @return XDO_ERROR if the window index is not enabled, the selection
+ *   failed, or nothing changed in time.
+ */
+int xdo_select_wait(xdo_select_t *selection, int timeout);
+
+/**
+ * Keep an index of all windows and the properties searched for.
+ *
+ * Once enabled, xdo_search_windows, xdo_search_plan_windows and
+ * xdo_select_windows answer from the index instead of asking the X server.
+ * The index is kept current by selecting SubstructureNotify and
+ * PropertyChange events on every window; the events are read from the
+ * Display's queue at the start of each search. Property changes the index
+ * has no use for, to properties it doesn't keep, are left in the queue.
+ *
+ * If you read events from the Display yourself (for example with
+ * XNextEvent), pass them to xdo_window_index_handle_event so the index sees
+ * them.
+ *
+ * @see xdo_disable_window_index
+ */
+int xdo_enable_window_index(xdo_t *xdo);
+
+/**
+ * Drop the window index, and take the event mask bits it added back out.
+ * Bits selected by anything else, before or since, are left alone.
+ */
+void xdo_disable_window_index(xdo_t *xdo);
+
+/**
+ * Apply any window events waiting in the Display's queue to the index.
+ *
+ * Events the index doesn't care about are left in the queue.
+ *
+ * @return XDO_ERROR if the index is not enabled.
+ */
+int xdo_window_index_update(const xdo_t *xdo);
+
+/**
+ * Wait until the window index changes: a window is created, destroyed,
+ * mapped, unmapped, moved in the tree or restacked, or one of its
+ * properties changes. Events that were already waiting count too.
+ *
+ * Use this to wait for a search to have results, running it again each
+ * time this returns; the search is answered from the index, so that costs
+ * nothing on the server.
+ *
+ * @param timeout How long to wait, in milliseconds. 0 waits for as long as
+ *   it takes.
+ * @return XDO_ERROR if the index is not enabled, or nothing changed in
+ *   time.
+ */
+int xdo_window_index_wait(const xdo_t *xdo, int timeout);
+
+/**
+ * Apply one event to the window index.
+ *
+ * @param event an event read from the same Display.
+ * @return True if the event was about an indexed window.
+ */
+int xdo_window_index_handle_event(const xdo_t *xdo, const XEvent *event);
+
 /**
  * Generic property fetch.
  *
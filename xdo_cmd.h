@@ -32,6 +32,10 @@ extern int window_is_valid(context_t *context, const char *window_arg);
 extern int window_get_arg(context_t *context, int min_arg, int window_arg_pos,
                           const char **window_arg);
 
+/* Parse a --timeout in milliseconds. Returns False, with a message, if arg
+ * isn't a number or is negative. */
+extern int parse_timeout(const char *cmd, const char *arg, int *timeout_ret);
+
 extern void xdotool_debug(context_t *context, const char *format, ...);
 extern void xdotool_output(context_t *context, const char *format, ...);
 
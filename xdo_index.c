@@ -0,0 +1,862 @@
+/* xdo window index
+ *
+ * Keeps a copy of the window tree, along with the window properties that
+ * searches look at, and keeps it current by listening for window events.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/Xutil.h>
+#include <xcb/xcb.h>
+#include "xdo.h"
+#include "xdo_search.h"
+
+/* Events the index selects on every window it knows about. Substructure
+ * events on a parent report its children being created, destroyed, mapped,
+ * unmapped, reparented and restacked. */
+#define INDEX_EVENT_MASK (SubstructureNotifyMask | PropertyChangeMask)
+
+/* Everything but the map state, which comes from the attributes that are
+ * read when the event mask is selected. */
+#define INDEX_FETCHMASK (FETCH_ALL & ~FETCH_ATTRIBUTES)
+
+typedef struct index_node {
+  Window window;
+  struct index_node *parent;    /* NULL for root windows */
+
+  /* Bottom to top in stacking order, the same as XQueryTree. */
+  struct index_node **children;
+  unsigned int nchildren;
+  unsigned int children_size;
+
+  /* The INDEX_EVENT_MASK bits the window didn't have selected already,
+   * which are the ones to take back out. */
+  long added_mask;
+
+  /* Set if the window itself is mapped. props.map_state also accounts for
+   * the ancestors, like the map_state from XGetWindowAttributes. */
+  int mapped;
+  xdo_window_props_t props;
+
+  struct index_node *next;      /* hash chain */
+} index_node_t;
+
+struct xdo_window_index {
+  index_node_t **buckets;
+  unsigned int nbuckets;        /* always a power of two */
+  unsigned int count;
+};
+
+static unsigned int hash_window(const struct xdo_window_index *index,
+                                Window window);
+static index_node_t *index_lookup(const struct xdo_window_index *index,
+                                  Window window);
+static void index_insert(struct xdo_window_index *index, index_node_t *node);
+static void index_unlink(struct xdo_window_index *index, index_node_t *node);
+static index_node_t *node_new(struct xdo_window_index *index, Window window,
+                              index_node_t *parent);
+static void node_free_tree(struct xdo_window_index *index, index_node_t *node);
+static void child_insert(index_node_t *parent, index_node_t *node,
+                         unsigned int position);
+static void child_remove(index_node_t *parent, index_node_t *node);
+static void update_map_state(index_node_t *node);
+static void update_props(const xdo_t *xdo, index_node_t *node, int fetchmask);
+static void update_property_list(index_node_t *node, Atom atom, int state);
+static void restack(index_node_t *node, Window above);
+static void index_subtrees(const xdo_t *xdo, index_node_t **nodes,
+                           unsigned int nnodes);
+static int index_wants_property(const xdo_t *xdo,
+                                const XPropertyEvent *event);
+static Bool index_event_predicate(Display *dpy, XEvent *event, XPointer arg);
+static int index_apply_event(const xdo_t *xdo, const XEvent *event,
+                             index_node_t **touched, int *subtree);
+static int subtree_matches(index_node_t *node, int subtree,
+                           xdo_window_match_t match, const void *data);
+
+int xdo_enable_window_index(xdo_t *xdo) {
+  struct xdo_window_index *index;
+  index_node_t **roots;
+  int i, screencount;
+
+  if (xdo->window_index != NULL)
+    return XDO_SUCCESS;
+
+  /* index_event_predicate looks at atoms, and can't ask for them itself. */
+  _xdo_property_fetchmask(xdo, None);
+
+  index = calloc(1, sizeof(*index));
+  index->nbuckets = 256;
+  index->buckets = calloc(index->nbuckets, sizeof(index_node_t *));
+  xdo->window_index = index;
+
+  screencount = ScreenCount(xdo->xdpy);
+  roots = calloc(screencount, sizeof(index_node_t *));
+  for (i = 0; i < screencount; i++) {
+    roots[i] = node_new(index, RootWindow(xdo->xdpy, i), NULL);
+  }
+
+  index_subtrees(xdo, roots, screencount);
+  free(roots);
+  return XDO_SUCCESS;
+} /* int xdo_enable_window_index */
+
+void xdo_disable_window_index(xdo_t *xdo) {
+  struct xdo_window_index *index = xdo->window_index;
+  xcb_connection_t *xcb;
+  xcb_get_window_attributes_cookie_t *cookies;
+  index_node_t **nodes;
+  unsigned int i, nnodes = 0;
+
+  if (index == NULL)
+    return;
+
+  xcb = XGetXCBConnection(xdo->xdpy);
+  XFlush(xdo->xdpy);
+
+  /* Take the bits the index added back out of the event masks, so that the
+   * server stops sending events that nobody will read. The rest of each
+   * mask is read again first, since something else (like focus tracking)
+   * may have selected more since. */
+  nodes = calloc(index->count ? index->count : 1, sizeof(index_node_t *));
+  cookies = calloc(index->count ? index->count : 1, sizeof(*cookies));
+  for (i = 0; i < index->nbuckets; i++) {
+    index_node_t *node;
+
+    for (node = index->buckets[i]; node != NULL; node = node->next) {
+      if (node->added_mask == 0)
+        continue;
+      cookies[nnodes] = xcb_get_window_attributes(xcb, node->window);
+      nodes[nnodes++] = node;
+    }
+  }
+
+  for (i = 0; i < nnodes; i++) {
+    xcb_get_window_attributes_reply_t *attr;
+    uint32_t mask;
+
+    /* No reply means the window is gone, and so is its mask. */
+    attr = xcb_get_window_attributes_reply(xcb, cookies[i], NULL);
+    if (attr == NULL)
+      continue;
+
+    mask = attr->your_event_mask & ~nodes[i]->added_mask;
+    free(attr);
+    xcb_discard_reply(xcb, xcb_change_window_attributes_checked(xcb,
+        nodes[i]->window, XCB_CW_EVENT_MASK, &mask).sequence);
+  }
+  xcb_flush(xcb);
+  free(cookies);
+  free(nodes);
+
+  for (i = 0; i < index->nbuckets; i++) {
+    index_node_t *node = index->buckets[i];
+
+    while (node != NULL) {
+      index_node_t *next = node->next;
+
+      _xdo_free_window_props(&node->props, 1);
+      free(node->children);
+      free(node);
+      node = next;
+    }
+  }
+
+  free(index->buckets);
+  free(index);
+  xdo->window_index = NULL;
+} /* void xdo_disable_window_index */
+
+int xdo_window_index_update(const xdo_t *xdo) {
+  XEvent event;
+
+  if (xdo->window_index == NULL)
+    return XDO_ERROR;
+
+  while (XCheckIfEvent(xdo->xdpy, &event, index_event_predicate,
+                       (XPointer)xdo)) {
+    xdo_window_index_handle_event(xdo, &event);
+  }
+
+  return XDO_SUCCESS;
+} /* int xdo_window_index_update */
+
+int xdo_window_index_wait(const xdo_t *xdo, int timeout) {
+  return _xdo_window_index_wait_match(xdo, timeout, NULL, NULL);
+} /* int xdo_window_index_wait */
+
+int _xdo_window_index_wait_match(const xdo_t *xdo, int timeout,
+                                 xdo_window_match_t match, const void *data) {
+  struct timespec deadline;
+  XEvent event;
+  int changed = False;
+
+  if (xdo->window_index == NULL)
+    return XDO_ERROR;
+
+  if (timeout > 0)
+    _xdo_time_after(&deadline, timeout);
+
+  for (;;) {
+    /* This takes what is queued and what is waiting on the connection. */
+    while (XCheckIfEvent(xdo->xdpy, &event, index_event_predicate,
+                         (XPointer)xdo)) {
+      index_node_t *touched;
+      int subtree;
+
+      /* The touched window may be gone after the next event, so it is
+       * checked straight away. */
+      if (index_apply_event(xdo, &event, &touched, &subtree)
+          && (match == NULL
+              || (touched != NULL
+                  && subtree_matches(touched, subtree, match, data))))
+        changed = True;
+    }
+
+    if (changed)
+      return XDO_SUCCESS;
+
+    if (!_xdo_wait_readable(xdo, timeout > 0 ? &deadline : NULL)) {
+      if (timeout > 0)
+        return XDO_ERROR;
+    }
+  }
+} /* int _xdo_window_index_wait_match */
+
+int xdo_window_index_handle_event(const xdo_t *xdo, const XEvent *event) {
+  index_node_t *touched;
+  int subtree;
+
+  return index_apply_event(xdo, event, &touched, &subtree);
+} /* int xdo_window_index_handle_event */
+
+/* Apply one event to the index, and return True if it changed anything.
+ * touched is set to the window the change could have made a search match,
+ * and subtree to whether that goes for everything below it too. touched
+ * is NULL if nothing can have started matching: windows that are
+ * destroyed, unmapped or restacked don't. */
+static int index_apply_event(const xdo_t *xdo, const XEvent *event,
+                             index_node_t **touched, int *subtree) {
+  struct xdo_window_index *index = xdo->window_index;
+  index_node_t *node;
+  index_node_t *parent;
+
+  *touched = NULL;
+  *subtree = True;
+  if (index == NULL)
+    return False;
+
+  switch (event->type) {
+    case CreateNotify:
+      parent = index_lookup(index, event->xcreatewindow.parent);
+
+      /* A window created just before its parent's children were queried is
+       * reported both ways. */
+      if (parent == NULL
+          || index_lookup(index, event->xcreatewindow.window) != NULL)
+        return False;
+
+      node = node_new(index, event->xcreatewindow.window, parent);
+      index_subtrees(xdo, &node, 1);
+      *touched = node;
+      return True;
+
+    case DestroyNotify:
+      node = index_lookup(index, event->xdestroywindow.window);
+      if (node == NULL)
+        return False;
+
+      if (node->parent != NULL)
+        child_remove(node->parent, node);
+      node_free_tree(index, node);
+      return True;
+
+    case ReparentNotify:
+      node = index_lookup(index, event->xreparent.window);
+      parent = index_lookup(index, event->xreparent.parent);
+      if (node == NULL)
+        return False;
+
+      /* Reported to both the old and the new parent. */
+      if (node->parent == parent)
+        return True;
+
+      if (node->parent != NULL)
+        child_remove(node->parent, node);
+
+      if (parent == NULL) {
+        node_free_tree(index, node);
+      } else {
+        child_insert(parent, node, parent->nchildren);
+        update_map_state(node);
+        *touched = node;
+      }
+      return True;
+
+    case MapNotify:
+    case UnmapNotify:
+      node = index_lookup(index, event->type == MapNotify
+                                 ? event->xmap.window : event->xunmap.window);
+      if (node == NULL)
+        return False;
+
+      node->mapped = (event->type == MapNotify);
+      update_map_state(node);
+      if (node->mapped)
+        *touched = node;
+      return True;
+
+    case ConfigureNotify:
+      node = index_lookup(index, event->xconfigure.window);
+      if (node == NULL || node->parent == NULL)
+        return False;
+
+      restack(node, event->xconfigure.above);
+      return True;
+
+    case CirculateNotify:
+      node = index_lookup(index, event->xcirculate.window);
+      if (node == NULL || node->parent == NULL)
+        return False;
+
+      child_remove(node->parent, node);
+      if (event->xcirculate.place == PlaceOnTop)
+        child_insert(node->parent, node, node->parent->nchildren);
+      else
+        child_insert(node->parent, node, 0);
+      return True;
+
+    case PropertyNotify:
+      node = index_lookup(index, event->xproperty.window);
+      if (node == NULL)
+        return False;
+
+      update_property_list(node, event->xproperty.atom,
+                           event->xproperty.state);
+      update_props(xdo, node,
+                   _xdo_property_fetchmask(xdo, event->xproperty.atom));
+      *touched = node;
+      *subtree = False;
+      return True;
+  }
+
+  return False;
+} /* int index_apply_event */
+
+/* Does match accept the window, or with subtree, anything below it? */
+static int subtree_matches(index_node_t *node, int subtree,
+                           xdo_window_match_t match, const void *data) {
+  xdo_window_props_t *record = &node->props;
+  unsigned int i;
+  int matched;
+
+  match(&record, 1, &matched, data);
+  if (matched)
+    return True;
+  if (!subtree)
+    return False;
+
+  for (i = 0; i < node->nchildren; i++) {
+    if (subtree_matches(node->children[i], True, match, data))
+      return True;
+  }
+  return False;
+} /* int subtree_matches */
+
+int _xdo_window_index_find(const xdo_t *xdo, const Window *roots,
+                           unsigned int nroots, long max_depth,
+                           xdo_window_match_t match, const void *data,
+                           xdo_window_results_t *results) {
+  index_node_t **queue;
+  unsigned int i, head = 0, tail = 0, level_end, queue_size;
+  long depth = 0;
+
+  if (xdo->window_index == NULL)
+    return XDO_ERROR;
+
+  queue_size = nroots > 64 ? nroots : 64;
+  queue = calloc(queue_size, sizeof(index_node_t *));
+  for (i = 0; i < nroots; i++) {
+    index_node_t *node = index_lookup(xdo->window_index, roots[i]);
+
+    if (node == NULL) {
+      free(queue);
+      return XDO_ERROR;
+    }
+    queue[tail++] = node;
+  }
+
+  /* Breadth first, one level of the tree at a time, the same as
+   * _xdo_find_windows. */
+  level_end = tail;
+  while (head < tail) {
+    index_node_t *node;
+    xdo_window_props_t *record;
+    int matched;
+
+    if (head == level_end) {
+      depth++;
+      level_end = tail;
+    }
+
+    if (results->stopped)
+      break;
+
+    node = queue[head++];
+    record = &node->props;
+    match(&record, 1, &matched, data);
+    if (matched)
+      _xdo_add_window_result(xdo, results, node->window);
+
+    /* Only queue children that are shallow enough to be checked. */
+    if (max_depth != -1 && depth + 1 > max_depth)
+      continue;
+
+    if (tail + node->nchildren > queue_size) {
+      while (tail + node->nchildren > queue_size)
+        queue_size *= 2;
+      queue = realloc(queue, queue_size * sizeof(index_node_t *));
+    }
+    memcpy(&queue[tail], node->children,
+           node->nchildren * sizeof(index_node_t *));
+    tail += node->nchildren;
+  }
+
+  free(queue);
+  return XDO_SUCCESS;
+} /* int _xdo_window_index_find */
+
+xdo_window_props_t *_xdo_window_index_lookup(const xdo_t *xdo,
+                                             Window window) {
+  index_node_t *node;
+
+  if (xdo->window_index == NULL)
+    return NULL;
+
+  node = index_lookup(xdo->window_index, window);
+  return node ? &node->props : NULL;
+} /* xdo_window_props_t *_xdo_window_index_lookup */
+
+static unsigned int hash_window(const struct xdo_window_index *index,
+                                Window window) {
+  /* Window ids are handed out sequentially within a client's id range, so
+   * the low bits are already well spread. Fold the client bits in too. */
+  return (unsigned int)(window ^ (window >> 18)) & (index->nbuckets - 1);
+} /* unsigned int hash_window */
+
+static index_node_t *index_lookup(const struct xdo_window_index *index,
+                                  Window window) {
+  index_node_t *node = index->buckets[hash_window(index, window)];
+
+  while (node != NULL && node->window != window)
+    node = node->next;
+
+  return node;
+} /* index_node_t *index_lookup */
+
+static void index_insert(struct xdo_window_index *index, index_node_t *node) {
+  unsigned int h;
+
+  if (index->count >= index->nbuckets) {
+    /* Keep chains short by doubling the table and rehashing. */
+    index_node_t **old = index->buckets;
+    unsigned int i, old_size = index->nbuckets;
+
+    index->nbuckets *= 2;
+    index->buckets = calloc(index->nbuckets, sizeof(index_node_t *));
+    for (i = 0; i < old_size; i++) {
+      index_node_t *n = old[i];
+
+      while (n != NULL) {
+        index_node_t *next = n->next;
+
+        h = hash_window(index, n->window);
+        n->next = index->buckets[h];
+        index->buckets[h] = n;
+        n = next;
+      }
+    }
+    free(old);
+  }
+
+  h = hash_window(index, node->window);
+  node->next = index->buckets[h];
+  index->buckets[h] = node;
+  index->count++;
+} /* void index_insert */
+
+static void index_unlink(struct xdo_window_index *index, index_node_t *node) {
+  index_node_t **link = &index->buckets[hash_window(index, node->window)];
+
+  while (*link != NULL && *link != node)
+    link = &(*link)->next;
+
+  if (*link != NULL) {
+    *link = node->next;
+    index->count--;
+  }
+} /* void index_unlink */
+
+static index_node_t *node_new(struct xdo_window_index *index, Window window,
+                              index_node_t *parent) {
+  index_node_t *node = calloc(1, sizeof(*node));
+
+  node->window = window;
+  _xdo_init_window_props(&node->props, &window, 1);
+  index_insert(index, node);
+
+  /* New windows go on top of their siblings. */
+  if (parent != NULL)
+    child_insert(parent, node, parent->nchildren);
+
+  return node;
+} /* index_node_t *node_new */
+
+/* Forget a window and everything below it. The node must already have been
+ * removed from its parent. */
+static void node_free_tree(struct xdo_window_index *index, index_node_t *node) {
+  unsigned int i;
+
+  for (i = 0; i < node->nchildren; i++)
+    node_free_tree(index, node->children[i]);
+
+  index_unlink(index, node);
+  _xdo_free_window_props(&node->props, 1);
+  free(node->children);
+  free(node);
+} /* void node_free_tree */
+
+static void child_insert(index_node_t *parent, index_node_t *node,
+                         unsigned int position) {
+  if (parent->nchildren == parent->children_size) {
+    parent->children_size = parent->children_size ? parent->children_size * 2
+                                                   : 8;
+    parent->children = realloc(parent->children,
+                               parent->children_size * sizeof(index_node_t *));
+  }
+
+  memmove(&parent->children[position + 1], &parent->children[position],
+          (parent->nchildren - position) * sizeof(index_node_t *));
+  parent->children[position] = node;
+  parent->nchildren++;
+  node->parent = parent;
+} /* void child_insert */
+
+static void child_remove(index_node_t *parent, index_node_t *node) {
+  unsigned int i;
+
+  for (i = 0; i < parent->nchildren; i++) {
+    if (parent->children[i] == node) {
+      memmove(&parent->children[i], &parent->children[i + 1],
+              (parent->nchildren - i - 1) * sizeof(index_node_t *));
+      parent->nchildren--;
+      break;
+    }
+  }
+  node->parent = NULL;
+} /* void child_remove */
+
+/* Recompute the map state of a window and everything below it. */
+static void update_map_state(index_node_t *node) {
+  unsigned int i;
+  int parent_viewable = (node->parent == NULL
+                         || node->parent->props.map_state == IsViewable);
+
+  if (!node->mapped)
+    node->props.map_state = IsUnmapped;
+  else if (parent_viewable)
+    node->props.map_state = IsViewable;
+  else
+    node->props.map_state = IsUnviewable;
+
+  for (i = 0; i < node->nchildren; i++)
+    update_map_state(node->children[i]);
+} /* void update_map_state */
+
+/* Fetch the given properties of a window again after they changed. */
+static void update_props(const xdo_t *xdo, index_node_t *node, int fetchmask) {
+  xdo_window_props_t fresh;
+  xdo_window_props_t *props = &node->props;
+
+  if (fetchmask == 0)
+    return;
+
+  _xdo_init_window_props(&fresh, &node->window, 1);
+  _xdo_fetch_window_props(xdo, fetchmask, &fresh, 1, NULL);
+
+  if (fetchmask & FETCH_DESKTOP)
+    props->desktop = fresh.desktop;
+
+  if (fetchmask & FETCH_PID)
+    props->pid = fresh.pid;
+
+  if (fetchmask & FETCH_NAME) {
+    free(props->name);
+    props->name = fresh.name;
+    fresh.name = NULL;
+  }
+
+  if (fetchmask & FETCH_CLASS) {
+    free(props->res_name);
+    free(props->res_class);
+    props->res_name = fresh.res_name;
+    props->res_class = fresh.res_class;
+    fresh.res_name = fresh.res_class = NULL;
+  }
+
+  if (fetchmask & FETCH_ROLE) {
+    if (props->role_list != NULL) {
+      free(props->role_list[0]);
+      free(props->role_list);
+    }
+    props->have_role = fresh.have_role;
+    props->role_list = fresh.role_list;
+    props->role_count = fresh.role_count;
+    fresh.role_list = NULL;
+  }
+
+  _xdo_free_window_props(&fresh, 1);
+} /* void update_props */
+
+static void update_property_list(index_node_t *node, Atom atom, int state) {
+  xdo_window_props_t *props = &node->props;
+  int i;
+
+  for (i = 0; i < props->nproperties; i++) {
+    if (props->properties[i] == atom)
+      break;
+  }
+
+  if (state == PropertyDelete) {
+    if (i < props->nproperties) {
+      props->properties[i] = props->properties[props->nproperties - 1];
+      props->nproperties--;
+    }
+  } else if (i == props->nproperties) {
+    props->properties = realloc(props->properties,
+                                (props->nproperties + 1) * sizeof(Atom));
+    props->properties[props->nproperties] = atom;
+    props->nproperties++;
+  }
+} /* void update_property_list */
+
+/* Move a window so that it is directly on top of 'above', or to the bottom
+ * if 'above' is None. */
+static void restack(index_node_t *node, Window above) {
+  index_node_t *parent = node->parent;
+  unsigned int i, position = 0;
+
+  child_remove(parent, node);
+
+  if (above != None) {
+    for (i = 0; i < parent->nchildren; i++) {
+      if (parent->children[i]->window == above) {
+        position = i + 1;
+        break;
+      }
+    }
+  }
+
+  child_insert(parent, node, position);
+} /* void restack */
+
+/* Fill in the given windows, which are already in the index, along with
+ * everything below them.
+ *
+ * The tree is read one level at a time, so each level costs the same few
+ * round trips no matter how many windows are on it. A window's events are
+ * selected before its map state, properties and children are read, so
+ * nothing that changes in between is missed; any such change is reported
+ * by an event. */
+static void index_subtrees(const xdo_t *xdo, index_node_t **nodes,
+                           unsigned int nnodes) {
+  struct xdo_window_index *index = xdo->window_index;
+  xcb_connection_t *xcb = XGetXCBConnection(xdo->xdpy);
+  index_node_t **level = calloc(nnodes ? nnodes : 1, sizeof(index_node_t *));
+  unsigned int i, nlevel = nnodes;
+
+  memcpy(level, nodes, nnodes * sizeof(index_node_t *));
+
+  /* Xlib may still have requests buffered; they have to go out first. */
+  XFlush(xdo->xdpy);
+
+  while (nlevel > 0) {
+    xcb_get_window_attributes_cookie_t *attr_cookies;
+    xcb_get_window_attributes_cookie_t *state_cookies;
+    xcb_query_tree_cookie_t *tree_cookies;
+    xdo_window_props_t *props;
+    Window *windows;
+    index_node_t **next = NULL;
+    unsigned int nnext = 0, next_size = 0;
+
+    attr_cookies = calloc(nlevel, sizeof(*attr_cookies));
+    state_cookies = calloc(nlevel, sizeof(*state_cookies));
+    tree_cookies = calloc(nlevel, sizeof(*tree_cookies));
+    props = calloc(nlevel, sizeof(xdo_window_props_t));
+    windows = calloc(nlevel, sizeof(Window));
+
+    for (i = 0; i < nlevel; i++) {
+      windows[i] = level[i]->window;
+      attr_cookies[i] = xcb_get_window_attributes(xcb, windows[i]);
+    }
+    xcb_flush(xcb);
+
+    /* The mask we already have on each window is needed to add to it. */
+    for (i = 0; i < nlevel; i++) {
+      xcb_generic_error_t *error = NULL;
+      xcb_get_window_attributes_reply_t *attr;
+      uint32_t mask;
+
+      attr = xcb_get_window_attributes_reply(xcb, attr_cookies[i], &error);
+      free(error);
+      if (attr == NULL)
+        continue;
+
+      level[i]->added_mask = INDEX_EVENT_MASK & ~attr->your_event_mask;
+      mask = attr->your_event_mask | INDEX_EVENT_MASK;
+      free(attr);
+
+      xcb_discard_reply(xcb, xcb_change_window_attributes_checked(xcb,
+          windows[i], XCB_CW_EVENT_MASK, &mask).sequence);
+    }
+
+    /* Everything read from here on is read after the events are selected.
+     * Query even windows that are gone already, the replies will just be
+     * errors or empty. Their DestroyNotify is on the way. */
+    for (i = 0; i < nlevel; i++) {
+      state_cookies[i] = xcb_get_window_attributes(xcb, windows[i]);
+      tree_cookies[i] = xcb_query_tree(xcb, windows[i]);
+    }
+    xcb_flush(xcb);
+
+    _xdo_init_window_props(props, windows, nlevel);
+    _xdo_fetch_window_props(xdo, INDEX_FETCHMASK, props, nlevel, NULL);
+
+    for (i = 0; i < nlevel; i++) {
+      xcb_generic_error_t *error = NULL;
+      xcb_get_window_attributes_reply_t *attr;
+      xcb_query_tree_reply_t *tree;
+      xcb_window_t *children;
+      int j, nchildren;
+
+      attr = xcb_get_window_attributes_reply(xcb, state_cookies[i], &error);
+      free(error);
+      error = NULL;
+      if (attr != NULL) {
+        level[i]->mapped = (attr->map_state != XCB_MAP_STATE_UNMAPPED);
+        free(attr);
+      }
+
+      /* The map state is filled in by update_map_state once the whole
+       * subtree is known, and kept current from then on. */
+      props[i].fetched |= FETCH_ATTRIBUTES;
+      level[i]->props = props[i];
+
+      tree = xcb_query_tree_reply(xcb, tree_cookies[i], &error);
+      free(error);
+      if (tree == NULL)
+        continue;
+
+      children = xcb_query_tree_children(tree);
+      nchildren = xcb_query_tree_children_length(tree);
+      for (j = 0; j < nchildren; j++) {
+        if (index_lookup(index, children[j]) != NULL)
+          continue;
+
+        if (nnext == next_size) {
+          next_size = next_size ? next_size * 2 : 64;
+          next = realloc(next, next_size * sizeof(index_node_t *));
+        }
+        next[nnext++] = node_new(index, children[j], level[i]);
+      }
+      free(tree);
+    }
+
+    free(attr_cookies);
+    free(state_cookies);
+    free(tree_cookies);
+    free(props);
+    free(windows);
+    free(level);
+    level = next;
+    nlevel = nnext;
+  }
+
+  free(level);
+
+  for (i = 0; i < nnodes; i++)
+    update_map_state(nodes[i]);
+} /* void index_subtrees */
+
+/* Only take the property changes that change the index: to a property it
+ * keeps, or a property coming or going from the window's list. The rest,
+ * like _NET_ACTIVE_WINDOW on the root, are left for whoever else is
+ * listening. This runs with the Display locked, so it can't make any
+ * requests. */
+static int index_wants_property(const xdo_t *xdo,
+                                const XPropertyEvent *event) {
+  index_node_t *node = index_lookup(xdo->window_index, event->window);
+  const xdo_window_props_t *props;
+  int i, listed = False;
+
+  if (node == NULL)
+    return False;
+
+  if (_xdo_property_fetchmask(xdo, event->atom) != 0)
+    return True;
+
+  props = &node->props;
+  for (i = 0; i < props->nproperties; i++) {
+    if (props->properties[i] == event->atom) {
+      listed = True;
+      break;
+    }
+  }
+
+  return listed == (event->state == PropertyDelete);
+} /* int index_wants_property */
+
+static Bool index_event_predicate(Display *dpy, XEvent *event, XPointer arg) {
+  const xdo_t *xdo = (const xdo_t *)arg;
+
+  Window subject;
+
+  (void)dpy;
+
+  /* Only take the substructure events reported to a parent, and leave the
+   * ones a window gets about itself to whoever asked for them. */
+  switch (event->type) {
+    case CreateNotify:
+      subject = None;
+      break;
+    case PropertyNotify:
+      return index_wants_property(xdo, &event->xproperty);
+    case DestroyNotify:
+      subject = event->xdestroywindow.window;
+      break;
+    case ReparentNotify:
+      subject = event->xreparent.window;
+      break;
+    case MapNotify:
+      subject = event->xmap.window;
+      break;
+    case UnmapNotify:
+      subject = event->xunmap.window;
+      break;
+    case ConfigureNotify:
+      subject = event->xconfigure.window;
+      break;
+    case CirculateNotify:
+      subject = event->xcirculate.window;
+      break;
+    default:
+      return False;
+  }
+
+  /* xany.window is the window the event was selected on. */
+  return event->xany.window != subject
+         && index_lookup(xdo->window_index, event->xany.window) != NULL;
+} /* Bool index_event_predicate */
+
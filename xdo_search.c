@@ -4,204 +4,508 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string.h>
 #include <regex.h>
 #include <stdio.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xatom.h>
 #include <X11/Xresource.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XTest.h>
+#include <xcb/xcb.h>
 #include "xdo.h"
+#include "xdo_search.h"
+
+/* The criteria a query can test, see plan_predicates. */
+enum {
+  PREDICATE_VISIBLE,
+  PREDICATE_DESKTOP,
+  PREDICATE_PID,
+  PREDICATE_CLASS,
+  PREDICATE_CLASSNAME,
+  PREDICATE_TITLE,
+  PREDICATE_NAME,
+  PREDICATE_ROLE,
+  PREDICATE_MAX
+};
+
+static const char *predicate_names[PREDICATE_MAX] = {
+  "visible", "desktop", "pid", "class", "classname", "title", "name", "role"
+};
+
+/* One criterion of a compiled query. */
+typedef struct predicate {
+  int id;           /* PREDICATE_* */
+  int fetch;        /* FETCH_* bit it needs */
+  int cost;         /* estimated, see plan_predicates */
+  int required;     /* must pass even when require is SEARCH_ANY */
+} predicate_t;
+
+/* Per-criterion counters for one search, printed when xdo->debug is set. */
+typedef struct predicate_stats {
+  unsigned int checked;
+  unsigned int passed;
+  unsigned int round_trips;   /* spent fetching for this criterion alone */
+} predicate_stats_t;
+
+/* Requests in flight for one window, see _xdo_fetch_window_props. */
+typedef struct window_cookies {
+  xcb_get_window_attributes_cookie_t attributes;
+  xcb_get_property_cookie_t desktop;
+  xcb_get_property_cookie_t pid;
+  xcb_get_property_cookie_t net_wm_name;
+  xcb_get_property_cookie_t wm_name;
+  xcb_get_property_cookie_t wm_class;
+  xcb_get_property_cookie_t role;
+  xcb_list_properties_cookie_t properties;
+} window_cookies_t;
+
+struct xdo_search_plan {
+  const xdo_t *xdo;
+
+  /* Private copy of the query this plan was compiled from. */
+  xdo_search_t search;
+
+  xdo_pattern_t title_re;
+  xdo_pattern_t class_re;
+  xdo_pattern_t classname_re;
+  xdo_pattern_t name_re;
+  xdo_pattern_t role_re;
+
+  /* The criteria to test, cheapest first. */
+  predicate_t predicates[PREDICATE_MAX];
+  int npredicates;
+};
+
+/* One run of a plan, see plan_match. */
+typedef struct search_run {
+  const xdo_search_plan_t *plan;
+  const xdo_t *xdo;                     /* whose connection to search on */
+  xdo_search_stats_t *stats;
+  predicate_stats_t *predicate_stats;   /* PREDICATE_MAX of them */
+} search_run_t;
+
+/* One screen of a SEARCH_PARALLEL search, see search_screens. */
+typedef struct screen_search {
+  xdo_t xdo;        /* a copy of the caller's, without a Display */
+  xcb_connection_t *xcb;
+  Window root;
+  search_run_t run;
+  xdo_window_results_t results;
+  xdo_search_stats_t stats;
+  predicate_stats_t predicate_stats[PREDICATE_MAX];
+  pthread_t thread;
+  int started;
+} screen_search_t;
+
+/* The connection of a SEARCH_PARALLEL thread, or NULL on any other
+ * thread. Such threads never touch the Display, since Xlib isn't safe to
+ * use from more than one thread unless XInitThreads was called first. */
+static __thread xcb_connection_t *screen_xcb;
+
+static Atom atom_NET_WM_DESKTOP = -1;
+static Atom atom_NET_WM_PID = -1;
+static Atom atom_NET_WM_NAME = -1;
+static Atom atom_WM_WINDOW_ROLE = -1;
+static Atom atom_NET_SUPPORTED = -1;
+static Atom atom_NET_CLIENT_LIST = -1;
+static Atom atom_NET_CLIENT_LIST_STACKING = -1;
+
+static int compile_re(const char *pattern, xdo_pattern_t *re);
+static int compile_regexps(xdo_search_plan_t *plan,
+                           const xdo_search_t *search);
+static void check_window_match(xdo_window_props_t **records,
+                               unsigned int nrecords, int *matched,
+                               const search_run_t *run);
+static int test_predicate(const xdo_search_plan_t *plan,
+                          const predicate_t *predicate,
+                          const xdo_window_props_t *props);
+static void plan_predicates(xdo_search_plan_t *plan);
+static void plan_match(xdo_window_props_t **records, unsigned int nrecords,
+                       int *matched, const void *data);
+static void intern_atoms(const xdo_t *xdo);
+static void fetch_records(const xdo_t *xdo, int fetchmask,
+                          xdo_window_props_t **records, unsigned int nwindows,
+                          xdo_search_stats_t *stats);
+static xcb_connection_t *search_connection(const xdo_t *xdo);
+static int _xdo_match_window_class(const xdo_window_props_t *props, const xdo_pattern_t *re);
+static int _xdo_match_window_classname(const xdo_window_props_t *props, const xdo_pattern_t *re);
+static int _xdo_match_window_role(const xdo_window_props_t *props, const xdo_pattern_t *re);
+static int _xdo_match_window_name(const xdo_window_props_t *props, const xdo_pattern_t *re);
+static int _xdo_match_window_title(const xdo_window_props_t *props, const xdo_pattern_t *re);
+static int _xdo_match_window_pid(const xdo_window_props_t *props, int pid);
+static int _xdo_is_window_visible(const xdo_window_props_t *props);
+static void run_plan(const xdo_search_plan_t *plan,
+                     xdo_window_results_t *results);
+static void search_roots(const search_run_t *run, const Window *roots,
+                         unsigned int nroots, xdo_window_results_t *results);
+static void search_screens(const search_run_t *run, const Window *roots,
+                           unsigned int nroots,
+                           xdo_window_results_t *results);
+static void *search_screen(void *arg);
+static unsigned int level_end(const xdo_window_results_t *results,
+                              unsigned int level);
+static xcb_query_tree_cookie_t *query_level(const xdo_t *xdo,
+                                            const Window *level,
+                                            unsigned int nlevel);
+static Window *read_level(const xdo_t *xdo, xcb_query_tree_cookie_t *cookies,
+                          unsigned int nlevel, unsigned int *nnext_ret);
+
+xdo_search_plan_t *xdo_search_plan_new(const xdo_t *xdo,
+                                       const xdo_search_t *search) {
+  xdo_search_plan_t *plan = calloc(1, sizeof(*plan));
+
+  plan->xdo = xdo;
+  plan->search = *search;
+
+  /* The patterns are only needed until they are compiled, so don't keep
+   * pointers into the caller's strings around. */
+  plan->search.title = NULL;
+  plan->search.winclass = NULL;
+  plan->search.winclassname = NULL;
+  plan->search.winname = NULL;
+  plan->search.winrole = NULL;
+
+  if (!compile_regexps(plan, search)) {
+    free(plan);
+    return NULL;
+  }
 
-static int compile_re(const char *pattern, regex_t *re);
-static int check_window_match(const xdo_t *xdo, Window wid, const xdo_search_t *search);
-static int _xdo_match_window_class(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_classname(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_role(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_name(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_title(const xdo_t *xdo, Window window, regex_t *re);
-static int _xdo_match_window_pid(const xdo_t *xdo, Window window, int pid);
-static int _xdo_is_window_visible(const xdo_t *xdo, Window wid);
-static void find_matching_windows(const xdo_t *xdo, Window window,
-                                  const xdo_search_t *search,
-                                  Window **windowlist_ret,
-                                  unsigned int *nwindows_ret,
-                                  unsigned int *windowlist_size,
-                                  int current_depth);
+  plan_predicates(plan);
 
-int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
-                      Window **windowlist_ret, unsigned int *nwindows_ret) {
-  int i = 0;
+  return plan;
+} /* xdo_search_plan_t *xdo_search_plan_new */
+
+void xdo_search_plan_free(xdo_search_plan_t *plan) {
+  if (plan == NULL)
+    return;
 
-  unsigned int windowlist_size = 100;
-  *nwindows_ret = 0;
-  *windowlist_ret = calloc(sizeof(Window), windowlist_size);
+  _xdo_pattern_free(&plan->title_re);
+  _xdo_pattern_free(&plan->class_re);
+  _xdo_pattern_free(&plan->classname_re);
+  _xdo_pattern_free(&plan->name_re);
+  _xdo_pattern_free(&plan->role_re);
+  free(plan);
+} /* void xdo_search_plan_free */
+
+int xdo_search_plan_windows(const xdo_search_plan_t *plan,
+                            Window **windowlist_ret,
+                            unsigned int *nwindows_ret) {
+  xdo_window_results_t results;
+
+  _xdo_init_window_results(&results, plan->search.limit, NULL, NULL);
+  run_plan(plan, &results);
+
+  *windowlist_ret = results.list;
+  *nwindows_ret = results.nwindows;
+  return XDO_SUCCESS;
+} /* int xdo_search_plan_windows */
+
+int xdo_search_plan_foreach(const xdo_search_plan_t *plan,
+                            xdo_window_found_t found, void *data) {
+  xdo_window_results_t results;
+
+  _xdo_init_window_results(&results, plan->search.limit, found, data);
+  run_plan(plan, &results);
+  return XDO_SUCCESS;
+} /* int xdo_search_plan_foreach */
+
+int xdo_search_plan_wait(const xdo_search_plan_t *plan, int timeout) {
+  xdo_search_stats_t stats = { 0, 0 };
+  predicate_stats_t predicate_stats[PREDICATE_MAX];
+  search_run_t run = { plan, plan->xdo, &stats, predicate_stats };
+
+  memset(predicate_stats, 0, sizeof(predicate_stats));
+  return _xdo_window_index_wait_match(plan->xdo, timeout, plan_match, &run);
+} /* int xdo_search_plan_wait */
+
+static void run_plan(const xdo_search_plan_t *plan,
+                     xdo_window_results_t *results) {
+  const xdo_t *xdo = plan->xdo;
+  const xdo_search_t *search = &plan->search;
+  xdo_search_stats_t stats = { 0, 0 };
+  predicate_stats_t predicate_stats[PREDICATE_MAX];
+  search_run_t run = { plan, plan->xdo, &stats, predicate_stats };
+  Window *roots;
+  unsigned int i, nroots;
+
+  memset(predicate_stats, 0, sizeof(predicate_stats));
 
   /* TODO(sissel): Support multiple screens */
   if (search->searchmask & SEARCH_SCREEN) {
-      Window root = RootWindow(xdo->xdpy, search->screen);
-      if (check_window_match(xdo, root, search)) {
-        (*windowlist_ret)[*nwindows_ret] = root;
-        (*nwindows_ret)++;
-        /* Don't have to check for size bounds here because
-         * we start with array size 100 */
-      }
+    nroots = 1;
+    roots = calloc(1, sizeof(Window));
+    roots[0] = RootWindow(xdo->xdpy, search->screen);
+  } else {
+    nroots = ScreenCount(xdo->xdpy);
+    roots = calloc(nroots, sizeof(Window));
+    for (i = 0; i < nroots; i++)
+      roots[i] = RootWindow(xdo->xdpy, i);
+  }
+
+  /* Catch the index up with what has changed, if there is one. */
+  if (xdo->window_index != NULL)
+    xdo_window_index_update(xdo);
+
+  /* The index answers from memory, there's nothing to gain from threads. */
+  if ((search->searchmask & SEARCH_PARALLEL) && nroots > 1
+      && xdo->window_index == NULL)
+    search_screens(&run, roots, nroots, results);
+  else
+    search_roots(&run, roots, nroots, results);
+
+  free(roots);
+
+  if (xdo->debug) {
+    fprintf(stderr, "search: checked %u windows, %u round trips, %u matches\n",
+            stats.windows, stats.round_trips, results->nwindows);
+    for (i = 0; i < (unsigned int)plan->npredicates; i++) {
+      const predicate_t *predicate = &plan->predicates[i];
+      const predicate_stats_t *counts = &predicate_stats[predicate->id];
+
+      fprintf(stderr, "search:   %s (cost %d): %u checked, %u passed, "
+              "%u round trips\n", predicate_names[predicate->id],
+              predicate->cost, counts->checked, counts->passed,
+              counts->round_trips);
+    }
+  }
 
-      /* Start with depth=1 since we already covered the root windows */
-      find_matching_windows(xdo, root, search, windowlist_ret, nwindows_ret,
-                            &windowlist_size, 1);
+} /* void run_plan */
+
+static void search_roots(const search_run_t *run, const Window *roots,
+                         unsigned int nroots, xdo_window_results_t *results) {
+  const xdo_t *xdo = run->xdo;
+  const xdo_search_plan_t *plan = run->plan;
+  const xdo_search_t *search = &plan->search;
+  Window *clients;
+  unsigned int nclients;
+
+  /* The index has the whole tree in memory, so there's no need to narrow
+   * it down. Only stacking order has to come from the window manager. */
+  if (xdo->window_index != NULL
+      && !(search->searchmask & SEARCH_STACKING)) {
+    _xdo_window_index_find(xdo, roots, nroots, search->max_depth,
+                           plan_match, run, results);
+  } else if (search->max_depth == -1
+      && !(search->searchmask & SEARCH_TREE)
+      && _xdo_get_client_list(xdo, roots, nroots,
+                              search->searchmask & SEARCH_STACKING, True,
+                              &clients, &nclients, run->stats)) {
+    /* The window manager keeps a list of every client window, so only
+     * those (and the roots, like the tree walk) need to be looked at. */
+    if (!_xdo_check_windows(xdo, roots, nroots, 0, plan_match, run,
+                            results, run->stats)) {
+      _xdo_end_window_level(results);
+      _xdo_check_windows(xdo, clients, nclients, 0, plan_match, run,
+                         results, run->stats);
+    }
+    free(clients);
+  } else if (xdo->window_index != NULL) {
+    /* Answer from memory */
+    _xdo_window_index_find(xdo, roots, nroots, search->max_depth,
+                           plan_match, run, results);
   } else {
-    const int screencount = ScreenCount(xdo->xdpy);
-    for (i = 0; i < screencount; i++) {
-      Window root = RootWindow(xdo->xdpy, i);
-      if (check_window_match(xdo, root, search)) {
-        (*windowlist_ret)[*nwindows_ret] = root;
-        (*nwindows_ret)++;
-        /* Don't have to check for size bounds here because
-         * we start with array size 100 */
-      }
+    _xdo_find_windows(xdo, roots, nroots, search->max_depth, 0, plan_match,
+                      run, results, run->stats);
+  }
+} /* void search_roots */
+
+/* Search each screen on a connection of its own, in a thread of its own,
+ * so that the time taken is that of the largest screen rather than that of
+ * all of them together. Once every screen is done, the results are handed
+ * on in the order search_roots would have found them in, so they don't
+ * depend on which thread finished first, or on SEARCH_PARALLEL at all. */
+static void search_screens(const search_run_t *run, const Window *roots,
+                           unsigned int nroots,
+                           xdo_window_results_t *results) {
+  const xdo_t *xdo = run->xdo;
+  screen_search_t *screens = calloc(nroots, sizeof(*screens));
+  unsigned int i, j, level;
+  int p, more;
+
+  /* The threads only read the atom cache, so fill it in beforehand. */
+  intern_atoms(xdo);
+
+  for (i = 0; i < nroots; i++) {
+    screen_search_t *screen = &screens[i];
+
+    screen->xdo = *xdo;
+    screen->xdo.xdpy = NULL;
+    screen->xcb = xcb_connect(DisplayString(xdo->xdpy), NULL);
+    screen->root = roots[i];
+    screen->run = *run;
+    screen->run.xdo = &screen->xdo;
+    screen->run.stats = &screen->stats;
+    screen->run.predicate_stats = screen->predicate_stats;
+
+    /* Each screen can stop at the limit; no more than that from any one
+     * screen can make it into the results. */
+    _xdo_init_window_results(&screen->results, results->limit, NULL, NULL);
+    screen->results.keep_levels = True;
+
+    screen->started = (!xcb_connection_has_error(screen->xcb)
+                       && pthread_create(&screen->thread, NULL, search_screen,
+                                         screen) == 0);
+  }
 
-      /* Start with depth=1 since we already covered the root windows */
-      find_matching_windows(xdo, root, search, windowlist_ret,
-                            nwindows_ret, &windowlist_size, 1);
+  /* Screens without a connection or thread of their own are searched on
+   * the caller's connection, while the others are busy. */
+  for (i = 0; i < nroots; i++) {
+    if (!screens[i].started) {
+      screens[i].run.xdo = xdo;
+      search_roots(&screens[i].run, &screens[i].root, 1,
+                   &screens[i].results);
     }
   }
 
-  //printf("Window count: %d\n", (int)ncandidate_windows);
-  //printf("Search:\n");
-  //printf("onlyvisible: %d\n", search->only_visible);
-  //printf("pid: %lu\n", search->pid);
-  //printf("title: %s\n", search->title);
-  //printf("name: %s\n", search->winname);
-  //printf("class: %s\n", search->winclass);
-  //printf("classname: %s\n", search->winclassname);
-  //printf("//Search\n");
+  for (i = 0; i < nroots; i++) {
+    screen_search_t *screen = &screens[i];
 
-  return XDO_SUCCESS;
+    if (screen->started)
+      pthread_join(screen->thread, NULL);
+    xcb_disconnect(screen->xcb);
+
+    run->stats->windows += screen->stats.windows;
+    run->stats->round_trips += screen->stats.round_trips;
+    for (p = 0; p < PREDICATE_MAX; p++) {
+      run->predicate_stats[p].checked += screen->predicate_stats[p].checked;
+      run->predicate_stats[p].passed += screen->predicate_stats[p].passed;
+      run->predicate_stats[p].round_trips +=
+        screen->predicate_stats[p].round_trips;
+    }
+  }
+
+  /* A search over every screen at once goes one level of the tree at a
+   * time, so take the first level from every screen, then the second, and
+   * so on. Each screen stopped at the limit, if there is one, and no
+   * screen can have more than that in the results either. */
+  for (level = 0, more = True; more && !results->stopped; level++) {
+    more = False;
+    for (i = 0; i < nroots; i++) {
+      const xdo_window_results_t *found = &screens[i].results;
+      unsigned int end = level_end(found, level);
+
+      for (j = level ? level_end(found, level - 1) : 0;
+           j < end && !results->stopped; j++)
+        _xdo_add_window_result(xdo, results, found->list[j]);
+      if (end < found->nwindows)
+        more = True;
+    }
+  }
+
+  for (i = 0; i < nroots; i++) {
+    free(screens[i].results.list);
+    free(screens[i].results.level_ends);
+  }
+  free(screens);
+} /* void search_screens */
+
+/* Where the given level ends in a screen's results. The last level the
+ * search got to may not have been finished, and has no end of its own. */
+static unsigned int level_end(const xdo_window_results_t *results,
+                              unsigned int level) {
+  return level < results->nlevels ? results->level_ends[level]
+                                  : results->nwindows;
+} /* unsigned int level_end */
+
+static void *search_screen(void *arg) {
+  screen_search_t *screen = arg;
+
+  screen_xcb = screen->xcb;
+  search_roots(&screen->run, &screen->root, 1, &screen->results);
+  return NULL;
+} /* void *search_screen */
+
+int xdo_search_windows(const xdo_t *xdo, const xdo_search_t *search,
+                      Window **windowlist_ret, unsigned int *nwindows_ret) {
+  int ret;
+  xdo_search_plan_t *plan = xdo_search_plan_new(xdo, search);
+
+  if (plan == NULL) {
+    *nwindows_ret = 0;
+    *windowlist_ret = calloc(sizeof(Window), 1);
+    return XDO_ERROR;
+  }
+
+  ret = xdo_search_plan_windows(plan, windowlist_ret, nwindows_ret);
+  xdo_search_plan_free(plan);
+  return ret;
 } /* int xdo_search_windows */
 
-static int _xdo_match_window_title(const xdo_t *xdo, Window window, regex_t *re) {
+static int _xdo_match_window_title(const xdo_window_props_t *props, const xdo_pattern_t *re) {
   fprintf(stderr, "This function (match window by title) is deprecated."
           " You want probably want to match by the window name.\n");
-  return _xdo_match_window_name(xdo, window, re);
+  return _xdo_match_window_name(props, re);
 } /* int _xdo_match_window_title */
 
-static int _xdo_match_window_name(const xdo_t *xdo, Window window, regex_t *re) {
+static int _xdo_match_window_name(const xdo_window_props_t *props, const xdo_pattern_t *re) {
   /* historically in xdo, 'match_name' matched the classhint 'name' which we
    * match in _xdo_match_window_classname. But really, most of the time 'name'
    * refers to the window manager name for the window, which is displayed in
    * the titlebar */
-  unsigned char *name;
-  int name_len;
-  int name_type;
-
-  xdo_get_window_name(xdo, window, &name, &name_len, &name_type);
+  const char *title = "";
 
-  char *title = "";
-  int result;
+  if (props->name != NULL)
+    title = props->name;
 
-  if (name_len)
-    title = (char *)name;
-
-  result = regexec(re, title, 0, NULL, 0);
-  free(name);
-  return result == 0;
+  return _xdo_pattern_match(re, title);
 } /* int _xdo_match_window_name */
 
-static int _xdo_match_window_class(const xdo_t *xdo, Window window, regex_t *re) {
-  XWindowAttributes attr;
-  XClassHint classhint;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
+static int _xdo_match_window_class(const xdo_window_props_t *props, const xdo_pattern_t *re) {
+  /* Treat windows with no class as empty strings */
+  const char *res_class = "";
 
-  if (XGetClassHint(xdo->xdpy, window, &classhint)) {
-    //printf("%d: class %s\n", window, classhint.res_class);
-    if ((classhint.res_class) && (regexec(re, classhint.res_class, 0, NULL, 0) == 0)) {
-      free(classhint.res_name);
-      free(classhint.res_class);
-      return True;
-    }
-    free(classhint.res_name);
-    free(classhint.res_class);
-  } else {
-    /* Treat windows with no class as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      return True;
-    }
-  }
-  return False;
+  if (props->res_class != NULL)
+    res_class = props->res_class;
+
+  return _xdo_pattern_match(re, res_class);
 } /* int _xdo_match_window_class */
 
-static int _xdo_match_window_classname(const xdo_t *xdo, Window window, regex_t *re) {
-  XWindowAttributes attr;
-  XClassHint classhint;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
+static int _xdo_match_window_classname(const xdo_window_props_t *props, const xdo_pattern_t *re) {
+  /* Treat windows with no class name as empty strings */
+  const char *res_name = "";
 
-  if (XGetClassHint(xdo->xdpy, window, &classhint)) {
-    if ((classhint.res_name) && (regexec(re, classhint.res_name, 0, NULL, 0) == 0)) {
-      free(classhint.res_name);
-      free(classhint.res_class);
-      return True;
-    }
-    free(classhint.res_name);
-    free(classhint.res_class);
-  } else {
-    /* Treat windows with no class name as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      return True;
-    }
-  }
-  return False;
+  if (props->res_name != NULL)
+    res_name = props->res_name;
+
+  return _xdo_pattern_match(re, res_name);
 } /* int _xdo_match_window_classname */
 
-static int _xdo_match_window_role(const xdo_t *xdo, Window window, regex_t *re) {
-  int status;
-  int ret = False;
+static int _xdo_match_window_role(const xdo_window_props_t *props, const xdo_pattern_t *re) {
   int i;
-  int count = 0;
-  char **list = NULL;
-  XTextProperty tp;
-
-  status = XGetTextProperty(xdo->xdpy, window, &tp,
-                            XInternAtom(xdo->xdpy, "WM_WINDOW_ROLE", False));
-  if (status && tp.nitems > 0) {
-    Xutf8TextPropertyToTextList(xdo->xdpy, &tp, &list, &count);
-    for (i = 0; i < count; i++) {
-      if (regexec(re, list[i], 0, NULL, 0) == 0) {
-        ret = True;
-      }
-    }
-  } else {
+
+  if (!props->have_role) {
     /* Treat windows with no role as empty strings */
-    if (regexec(re, "", 0, NULL, 0) == 0) {
-      ret = True;
-    }
+    return _xdo_pattern_match(re, "");
   }
-  if(status) {
-    XFreeStringList(list);
-    free(tp.value);
+
+  for (i = 0; i < props->role_count; i++) {
+    if (_xdo_pattern_match(re, props->role_list[i])) {
+      return True;
+    }
   }
-  return ret;
+  return False;
 } /* int _xdo_match_window_role */
 
-static int _xdo_match_window_pid(const xdo_t *xdo, Window window, const int pid) {
-  int window_pid;
-
-  window_pid = xdo_get_pid_window(xdo, window);
-  if (pid == window_pid) {
+static int _xdo_match_window_pid(const xdo_window_props_t *props, const int pid) {
+  if (pid == props->pid) {
     return True;
   } else {
     return False;
   }
 } /* int _xdo_match_window_pid */
 
-static int compile_re(const char *pattern, regex_t *re) {
+static int compile_re(const char *pattern, xdo_pattern_t *re) {
   int ret;
   if (pattern == NULL) {
-    regcomp(re, "^$", REG_EXTENDED | REG_ICASE);
+    _xdo_pattern_compile(re, "^$");
     return True;
   }
 
-  ret = regcomp(re, pattern, REG_EXTENDED | REG_ICASE);
+  ret = _xdo_pattern_compile(re, pattern);
   if (ret != 0) {
     fprintf(stderr, "Failed to compile regex (return code %d): '%s'\n", ret, pattern);
     return False;
@@ -209,22 +513,586 @@ static int compile_re(const char *pattern, regex_t *re) {
   return True;
 } /* int compile_re */
 
-static int _xdo_is_window_visible(const xdo_t *xdo, Window wid) {
-  XWindowAttributes wattr;
-  XGetWindowAttributes(xdo->xdpy, wid, &wattr);
-  if (wattr.map_state != IsViewable)
+/* How a pattern is matched, see xdo_pattern_t. */
+enum {
+  PATTERN_REGEX,
+  PATTERN_SUBSTRING,  /* text */
+  PATTERN_PREFIX,     /* ^text */
+  PATTERN_SUFFIX,     /* text$ */
+  PATTERN_EXACT       /* ^text$ */
+};
+
+/* Characters with a meaning in an extended regex. */
+static const char regex_special[] = "^$.[]()|*+?{}\\";
+
+static char ascii_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+} /* char ascii_lower */
+
+/* Compare len characters of text against a lowercase literal. */
+static int equal_fold(const char *text, const char *literal, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (ascii_lower(text[i]) != literal[i])
+      return False;
+  }
+  return True;
+} /* int equal_fold */
+
+/* Look for a lowercase literal anywhere in text.
+ *
+ * Candidates are found by scanning for either case of the first character
+ * with memchr, which libc vectorizes, so most of the text is never looked at
+ * one byte at a time. */
+static int contains_fold(const char *text, size_t text_len,
+                         const char *literal, size_t len) {
+  const char *end, *p = text;
+  const char *lower_at = NULL, *upper_at = NULL;
+  char lower, upper;
+
+  if (len == 0)
+    return True;
+  if (text_len < len)
+    return False;
+
+  /* One past the last place the literal could start. */
+  end = text + text_len - len + 1;
+  lower = literal[0];
+  upper = (lower >= 'a' && lower <= 'z') ? lower - 'a' + 'A' : lower;
+
+  while (p < end) {
+    const char *hit;
+
+    if (lower_at == NULL || lower_at < p) {
+      lower_at = memchr(p, lower, end - p);
+      if (lower_at == NULL)
+        lower_at = end;
+    }
+    if (upper_at == NULL || upper_at < p) {
+      upper_at = (upper == lower) ? end : memchr(p, upper, end - p);
+      if (upper_at == NULL)
+        upper_at = end;
+    }
+
+    hit = lower_at < upper_at ? lower_at : upper_at;
+    if (hit == end)
+      return False;
+
+    if (equal_fold(hit + 1, literal + 1, len - 1))
+      return True;
+
+    p = hit + 1;
+  }
+
+  return False;
+} /* int contains_fold */
+
+/* Turn a pattern into the literal text it matches, if it is one.
+ *
+ * Returns NULL if the pattern uses any regex operator other than a leading
+ * ^ or trailing $, or has non-ASCII text (REG_ICASE folds case according to
+ * the locale there, which a byte compare can't do). */
+static char *pattern_literal(const char *text, int *kind_ret,
+                             size_t *len_ret) {
+  const char *p = text;
+  const char *end = text + strlen(text);
+  int anchor_start = False, anchor_end = False;
+  char *literal, *out;
+
+  if (*p == '^') {
+    anchor_start = True;
+    p++;
+  }
+
+  if (end > p && end[-1] == '$') {
+    /* An escaped \$ is a literal dollar sign. */
+    const char *q = end - 1;
+    int backslashes = 0;
+
+    while (q > p && q[-1] == '\\') {
+      backslashes++;
+      q--;
+    }
+    if (backslashes % 2 == 0) {
+      anchor_end = True;
+      end--;
+    }
+  }
+
+  literal = out = malloc(end - p + 1);
+  while (p < end) {
+    char c = *p++;
+
+    if (c & 0x80) {
+      free(literal);
+      return NULL;
+    }
+
+    if (c == '\\') {
+      /* \ before an operator makes it literal; anything else (\w, \<, ...)
+       * is left to the regex engine. */
+      if (p == end || strchr(regex_special, *p) == NULL) {
+        free(literal);
+        return NULL;
+      }
+      c = *p++;
+    } else if (strchr(regex_special, c) != NULL) {
+      free(literal);
+      return NULL;
+    }
+
+    *out++ = ascii_lower(c);
+  }
+  *out = '\0';
+
+  if (anchor_start && anchor_end)
+    *kind_ret = PATTERN_EXACT;
+  else if (anchor_start)
+    *kind_ret = PATTERN_PREFIX;
+  else if (anchor_end)
+    *kind_ret = PATTERN_SUFFIX;
+  else
+    *kind_ret = PATTERN_SUBSTRING;
+
+  *len_ret = out - literal;
+  return literal;
+} /* char *pattern_literal */
+
+/* Whether text has any byte outside ASCII. */
+static int has_non_ascii(const char *text) {
+  for (; *text != '\0'; text++) {
+    if (*text & 0x80)
+      return True;
+  }
+  return False;
+} /* int has_non_ascii */
+
+int _xdo_pattern_compile(xdo_pattern_t *pattern, const char *text) {
+  int ret;
+
+  memset(pattern, 0, sizeof(*pattern));
+
+  pattern->literal = pattern_literal(text, &pattern->kind, &pattern->len);
+  if (pattern->literal != NULL) {
+    /* In a multibyte locale REG_ICASE also folds a few non-ASCII letters
+     * to ASCII ones: LONG S to s, DOTLESS I to i, and depending on the libc
+     * KELVIN SIGN to k. A literal with any of those letters keeps a regex
+     * around for titles that aren't plain ASCII. */
+    if (strpbrk(pattern->literal, "iks") == NULL)
+      return 0;
+    ret = regcomp(&pattern->re, text, REG_EXTENDED | REG_ICASE);
+    pattern->has_re = (ret == 0);
+    if (ret != 0) {
+      free(pattern->literal);
+      pattern->literal = NULL;
+    }
+    return ret;
+  }
+
+  pattern->kind = PATTERN_REGEX;
+  ret = regcomp(&pattern->re, text, REG_EXTENDED | REG_ICASE);
+  pattern->has_re = (ret == 0);
+  return ret;
+} /* int _xdo_pattern_compile */
+
+int _xdo_pattern_match(const xdo_pattern_t *pattern, const char *text) {
+  size_t text_len;
+
+  if (pattern->kind == PATTERN_REGEX
+      || (pattern->has_re && MB_CUR_MAX > 1 && has_non_ascii(text)))
+    return regexec(&pattern->re, text, 0, NULL, 0) == 0;
+
+  switch (pattern->kind) {
+    case PATTERN_PREFIX:
+      /* Stops at the end of text, since the literal has no nulls. */
+      return equal_fold(text, pattern->literal, pattern->len);
+  }
+
+  text_len = strlen(text);
+  switch (pattern->kind) {
+    case PATTERN_EXACT:
+      return text_len == pattern->len
+             && equal_fold(text, pattern->literal, pattern->len);
+    case PATTERN_SUFFIX:
+      return text_len >= pattern->len
+             && equal_fold(text + text_len - pattern->len, pattern->literal,
+                           pattern->len);
+    case PATTERN_SUBSTRING:
+      return contains_fold(text, text_len, pattern->literal, pattern->len);
+  }
+
+  return False;
+} /* int _xdo_pattern_match */
+
+void _xdo_pattern_free(xdo_pattern_t *pattern) {
+  if (pattern->has_re)
+    regfree(&pattern->re);
+  free(pattern->literal);
+} /* void _xdo_pattern_free */
+
+static int _xdo_is_window_visible(const xdo_window_props_t *props) {
+  if (props->map_state != IsViewable)
     return False;
 
   return True;
 } /* int _xdo_is_window_visible */
 
-static int compile_regexps(const xdo_search_t *search,
-                           regex_t *title_re,
-                           regex_t *class_re,
-                           regex_t *classname_re,
-                           regex_t *name_re,
-                           regex_t *role_re)
+static xcb_get_property_cookie_t get_property(xcb_connection_t *xcb,
+                                              Window window, Atom atom) {
+  return xcb_get_property(xcb, 0, window, atom, XCB_GET_PROPERTY_TYPE_ANY,
+                          0, UINT32_MAX);
+} /* xcb_get_property_cookie_t get_property */
+
+/* Wait for a property reply. Returns NULL if the window is gone or does not
+ * have the property. */
+static xcb_get_property_reply_t *get_property_reply(xcb_connection_t *xcb,
+    xcb_get_property_cookie_t cookie) {
+  xcb_generic_error_t *error = NULL;
+  xcb_get_property_reply_t *reply;
+
+  reply = xcb_get_property_reply(xcb, cookie, &error);
+  free(error);
+
+  if (reply != NULL && reply->type == XCB_NONE) {
+    free(reply);
+    return NULL;
+  }
+  return reply;
+} /* xcb_get_property_reply_t *get_property_reply */
+
+/* Copy a property value, adding a terminating null like XGetWindowProperty
+ * does. */
+static char *property_string(xcb_get_property_reply_t *reply, int *len_ret) {
+  int len = xcb_get_property_value_length(reply);
+  char *value = malloc(len + 1);
+
+  memcpy(value, xcb_get_property_value(reply), len);
+  value[len] = '\0';
+
+  if (len_ret != NULL)
+    *len_ret = len;
+  return value;
+} /* char *property_string */
+
+static void read_class_hint(xcb_get_property_reply_t *reply,
+                            xdo_window_props_t *props) {
+  /* Same rules as XGetClassHint: two null-separated STRINGs */
+  int len;
+  char *value;
+
+  if (reply->type != XA_STRING || reply->format != 8)
+    return;
+
+  value = property_string(reply, &len);
+  props->res_name = strdup(value);
+  if ((int)strlen(value) < len)
+    props->res_class = strdup(value + strlen(value) + 1);
+  else
+    props->res_class = strdup("");
+  free(value);
+} /* void read_class_hint */
+
+/* Split a text property into its null-separated strings, in UTF-8, the
+ * same way Xutf8TextPropertyToTextList does: STRING is Latin-1, and
+ * UTF8_STRING is already UTF-8. Anything else is taken as it is. This
+ * doesn't use Xlib, so that SEARCH_PARALLEL threads can call it.
+ *
+ * As with Xlib's lists, role_list[0] holds all of the strings, and is
+ * freed along with role_list. */
+static void read_role(xcb_get_property_reply_t *reply,
+                      xdo_window_props_t *props) {
+  const unsigned char *value = xcb_get_property_value(reply);
+  int len = xcb_get_property_value_length(reply);
+  int latin1 = (reply->type == XA_STRING);
+  char *text, *out;
+  int i, count = 1;
+
+  if (reply->value_len == 0 || reply->format != 8)
+    return;
+
+  for (i = 0; i < len; i++) {
+    if (value[i] == '\0')
+      count++;
+  }
+
+  /* Each Latin-1 character takes at most two bytes of UTF-8. */
+  text = malloc(2 * len + 1);
+  props->role_list = malloc(count * sizeof(char *));
+  props->role_list[0] = text;
+  props->role_count = count;
+  props->have_role = True;
+
+  out = text;
+  count = 1;
+  for (i = 0; i < len; i++) {
+    unsigned char c = value[i];
+
+    if (c == '\0') {
+      *out++ = '\0';
+      props->role_list[count++] = out;
+    } else if (latin1 && c >= 0x80) {
+      *out++ = 0xC0 | (c >> 6);
+      *out++ = 0x80 | (c & 0x3F);
+    } else {
+      *out++ = c;
+    }
+  }
+  *out = '\0';
+} /* void read_role */
+
+void _xdo_init_window_props(xdo_window_props_t *props, const Window *windows,
+                            unsigned int nwindows) {
+  unsigned int i;
+
+  memset(props, 0, nwindows * sizeof(xdo_window_props_t));
+  for (i = 0; i < nwindows; i++) {
+    props[i].window = windows[i];
+    props[i].map_state = IsUnmapped;
+    props[i].desktop = -1;
+  }
+} /* void _xdo_init_window_props */
+
+/* Fetch the properties in fetchmask that a list of records are missing.
+ *
+ * All of the requests are sent before any reply is read, so this costs one
+ * round trip no matter how many windows or criteria there are, and nothing
+ * at all if the records are already filled in. */
+static void fetch_records(const xdo_t *xdo, int fetchmask,
+                          xdo_window_props_t **records, unsigned int nwindows,
+                          xdo_search_stats_t *stats) {
+  xcb_connection_t *xcb;
+  window_cookies_t *cookies;
+  int *want;
+  int any = 0;
+  unsigned int i;
+
+  if (nwindows == 0 || fetchmask == 0)
+    return;
+
+  want = calloc(nwindows, sizeof(int));
+  for (i = 0; i < nwindows; i++) {
+    want[i] = fetchmask & ~records[i]->fetched;
+    any |= want[i];
+  }
+
+  if (any == 0) {
+    free(want);
+    return;
+  }
+
+  intern_atoms(xdo);
+  xcb = search_connection(xdo);
+  cookies = calloc(nwindows, sizeof(window_cookies_t));
+
+  for (i = 0; i < nwindows; i++) {
+    Window w = records[i]->window;
+    int missing = want[i];
+
+    if (missing & FETCH_ATTRIBUTES)
+      cookies[i].attributes = xcb_get_window_attributes(xcb, w);
+    if (missing & FETCH_DESKTOP)
+      cookies[i].desktop = get_property(xcb, w, atom_NET_WM_DESKTOP);
+    if (missing & FETCH_PID)
+      cookies[i].pid = get_property(xcb, w, atom_NET_WM_PID);
+    if (missing & FETCH_NAME) {
+      cookies[i].net_wm_name = get_property(xcb, w, atom_NET_WM_NAME);
+      cookies[i].wm_name = get_property(xcb, w, XA_WM_NAME);
+    }
+    if (missing & FETCH_CLASS)
+      cookies[i].wm_class = get_property(xcb, w, XA_WM_CLASS);
+    if (missing & FETCH_ROLE)
+      cookies[i].role = get_property(xcb, w, atom_WM_WINDOW_ROLE);
+    if (missing & FETCH_PROPERTIES)
+      cookies[i].properties = xcb_list_properties(xcb, w);
+  }
+  xcb_flush(xcb);
+
+  if (stats != NULL)
+    stats->round_trips++;
+
+  for (i = 0; i < nwindows; i++) {
+    xdo_window_props_t *p = records[i];
+    xcb_get_property_reply_t *reply;
+    int missing = want[i];
+
+    p->fetched |= missing;
+
+    if (missing & FETCH_ATTRIBUTES) {
+      xcb_generic_error_t *error = NULL;
+      xcb_get_window_attributes_reply_t *attr;
+
+      attr = xcb_get_window_attributes_reply(xcb, cookies[i].attributes,
+                                             &error);
+      free(error);
+      if (attr != NULL) {
+        p->map_state = attr->map_state;
+        free(attr);
+      }
+    }
+
+    if (missing & FETCH_DESKTOP) {
+      reply = get_property_reply(xcb, cookies[i].desktop);
+      if (reply != NULL && reply->format == 32 && reply->value_len > 0) {
+        p->desktop = *(int32_t *)xcb_get_property_value(reply);
+      }
+      free(reply);
+    }
+
+    if (missing & FETCH_PID) {
+      reply = get_property_reply(xcb, cookies[i].pid);
+      if (reply != NULL && reply->format == 32 && reply->value_len > 0) {
+        p->pid = (int)*(uint32_t *)xcb_get_property_value(reply);
+      }
+      free(reply);
+    }
+
+    if (missing & FETCH_NAME) {
+      /* Prefer _NET_WM_NAME if available, otherwise use WM_NAME */
+      xcb_get_property_reply_t *wm_name;
+
+      reply = get_property_reply(xcb, cookies[i].net_wm_name);
+      wm_name = get_property_reply(xcb, cookies[i].wm_name);
+      if (reply != NULL && reply->value_len > 0) {
+        p->name = property_string(reply, NULL);
+      } else if (wm_name != NULL && wm_name->value_len > 0) {
+        p->name = property_string(wm_name, NULL);
+      }
+      free(reply);
+      free(wm_name);
+    }
+
+    if (missing & FETCH_CLASS) {
+      reply = get_property_reply(xcb, cookies[i].wm_class);
+      if (reply != NULL) {
+        read_class_hint(reply, p);
+      }
+      free(reply);
+    }
+
+    if (missing & FETCH_ROLE) {
+      reply = get_property_reply(xcb, cookies[i].role);
+      if (reply != NULL) {
+        read_role(reply, p);
+      }
+      free(reply);
+    }
+
+    if (missing & FETCH_PROPERTIES) {
+      xcb_generic_error_t *error = NULL;
+      xcb_list_properties_reply_t *list;
+
+      list = xcb_list_properties_reply(xcb, cookies[i].properties, &error);
+      free(error);
+      if (list != NULL) {
+        int j, n = xcb_list_properties_atoms_length(list);
+        xcb_atom_t *atoms = xcb_list_properties_atoms(list);
+
+        p->properties = calloc(n ? n : 1, sizeof(Atom));
+        for (j = 0; j < n; j++)
+          p->properties[j] = atoms[j];
+        p->nproperties = n;
+        free(list);
+      }
+    }
+  }
+
+  free(cookies);
+  free(want);
+} /* void fetch_records */
+
+void _xdo_fetch_window_props(const xdo_t *xdo, int fetchmask,
+                             xdo_window_props_t *props, unsigned int nwindows,
+                             xdo_search_stats_t *stats) {
+  xdo_window_props_t **records;
+  unsigned int i;
+
+  if (nwindows == 0 || fetchmask == 0)
+    return;
+
+  records = calloc(nwindows, sizeof(xdo_window_props_t *));
+  for (i = 0; i < nwindows; i++)
+    records[i] = &props[i];
+  fetch_records(xdo, fetchmask, records, nwindows, stats);
+  free(records);
+} /* void _xdo_fetch_window_props */
+
+void _xdo_free_window_props(xdo_window_props_t *props, unsigned int nwindows) {
+  unsigned int i;
+
+  for (i = 0; i < nwindows; i++) {
+    free(props[i].name);
+    free(props[i].res_name);
+    free(props[i].res_class);
+    if (props[i].role_list != NULL) {
+      free(props[i].role_list[0]);
+      free(props[i].role_list);
+    }
+    free(props[i].properties);
+  }
+} /* void _xdo_free_window_props */
+
+/* The connection to send a search's requests on. On the Display's, Xlib
+ * may still have requests buffered; they have to go out first. */
+static xcb_connection_t *search_connection(const xdo_t *xdo) {
+  if (screen_xcb != NULL)
+    return screen_xcb;
+
+  XFlush(xdo->xdpy);
+  return XGetXCBConnection(xdo->xdpy);
+} /* xcb_connection_t *search_connection */
+
+static void intern_atoms(const xdo_t *xdo) {
+  /* SEARCH_PARALLEL threads only start once these are all filled in. */
+  if (atom_NET_WM_DESKTOP == (Atom)-1) {
+    atom_NET_WM_DESKTOP = XInternAtom(xdo->xdpy, "_NET_WM_DESKTOP", False);
+  }
+  if (atom_NET_WM_PID == (Atom)-1) {
+    atom_NET_WM_PID = XInternAtom(xdo->xdpy, "_NET_WM_PID", False);
+  }
+  if (atom_NET_WM_NAME == (Atom)-1) {
+    atom_NET_WM_NAME = XInternAtom(xdo->xdpy, "_NET_WM_NAME", False);
+  }
+  if (atom_WM_WINDOW_ROLE == (Atom)-1) {
+    atom_WM_WINDOW_ROLE = XInternAtom(xdo->xdpy, "WM_WINDOW_ROLE", False);
+  }
+  if (atom_NET_SUPPORTED == (Atom)-1) {
+    atom_NET_SUPPORTED = XInternAtom(xdo->xdpy, "_NET_SUPPORTED", False);
+  }
+  if (atom_NET_CLIENT_LIST == (Atom)-1) {
+    atom_NET_CLIENT_LIST = XInternAtom(xdo->xdpy, "_NET_CLIENT_LIST", False);
+  }
+  if (atom_NET_CLIENT_LIST_STACKING == (Atom)-1) {
+    atom_NET_CLIENT_LIST_STACKING = XInternAtom(xdo->xdpy,
+        "_NET_CLIENT_LIST_STACKING", False);
+  }
+} /* void intern_atoms */
+
+int _xdo_property_fetchmask(const xdo_t *xdo, Atom atom) {
+  intern_atoms(xdo);
+
+  if (atom == atom_NET_WM_DESKTOP)
+    return FETCH_DESKTOP;
+  if (atom == atom_NET_WM_PID)
+    return FETCH_PID;
+  if (atom == atom_NET_WM_NAME || atom == XA_WM_NAME)
+    return FETCH_NAME;
+  if (atom == XA_WM_CLASS)
+    return FETCH_CLASS;
+  if (atom == atom_WM_WINDOW_ROLE)
+    return FETCH_ROLE;
+
+  return 0;
+} /* int _xdo_property_fetchmask */
+
+static int compile_regexps(xdo_search_plan_t *plan,
+                           const xdo_search_t *search)
 {
+  xdo_pattern_t *title_re = &plan->title_re;
+  xdo_pattern_t *class_re = &plan->class_re;
+  xdo_pattern_t *classname_re = &plan->classname_re;
+  xdo_pattern_t *name_re = &plan->name_re;
+  xdo_pattern_t *role_re = &plan->role_re;
   int result = True;
 
   if (!compile_re(search->title, title_re)) {
@@ -232,226 +1100,499 @@ static int compile_regexps(const xdo_search_t *search,
   }
 
   if (result && !compile_re(search->winclass, class_re)) {
-    regfree(title_re);
+    _xdo_pattern_free(title_re);
     return False;
   }
 
   if (result && !compile_re(search->winclassname, classname_re)) {
-    regfree(class_re);
-    regfree(title_re);
+    _xdo_pattern_free(class_re);
+    _xdo_pattern_free(title_re);
     return False;
   }
 
   if (result && !compile_re(search->winrole, role_re)) {
-    regfree(classname_re);
-    regfree(class_re);
-    regfree(title_re);
+    _xdo_pattern_free(classname_re);
+    _xdo_pattern_free(class_re);
+    _xdo_pattern_free(title_re);
     return False;
   }
 
   if (result && !compile_re(search->winname, name_re)) {
-    regfree(role_re);
-    regfree(classname_re);
-    regfree(class_re);
-    regfree(title_re);
+    _xdo_pattern_free(role_re);
+    _xdo_pattern_free(classname_re);
+    _xdo_pattern_free(class_re);
+    _xdo_pattern_free(title_re);
     return False;
   }
 
   return result;
 }
 
-static int check_window_match(const xdo_t *xdo, Window wid,
-                              const xdo_search_t *search) {
-  regex_t title_re;
-  regex_t class_re;
-  regex_t classname_re;
-  regex_t name_re;
-  regex_t role_re;
-
-  int re_ok = 0;
-  re_ok = compile_regexps(search, &title_re, &class_re, &classname_re, &name_re,
-                  &role_re);
+static void plan_match(xdo_window_props_t **records, unsigned int nrecords,
+                       int *matched, const void *data) {
+  const search_run_t *run = (const search_run_t *)data;
 
-  if (re_ok == 0)
-    return False;
+  check_window_match(records, nrecords, matched, run);
+} /* void plan_match */
 
-  /* Set this to 1 for dev debugging */
-  static const int debug = 0;
-
-  int visible_ok, pid_ok, title_ok, name_ok, class_ok, classname_ok, desktop_ok;
-  int visible_want, pid_want, title_want, name_want, class_want, classname_want, desktop_want;
-  int role_ok, role_want;
-
-  visible_ok = pid_ok = title_ok = name_ok = class_ok = classname_ok = desktop_ok = True;
-    //(search->require == SEARCH_ANY ? False : True);
-
-  desktop_want = search->searchmask & SEARCH_DESKTOP;
-  visible_want = search->searchmask & SEARCH_ONLYVISIBLE;
-  pid_want = search->searchmask & SEARCH_PID;
-  title_want = search->searchmask & SEARCH_TITLE;
-  name_want = search->searchmask & SEARCH_NAME;
-  class_want = search->searchmask & SEARCH_CLASS;
-  classname_want = search->searchmask & SEARCH_CLASSNAME;
-  role_ok = True;
-  role_want = search->searchmask & SEARCH_ROLE;
-
-  do {
-    if (desktop_want) {
-      long desktop = -1;
-
-      /* We're modifying xdo here, but since we restore it, we're still
-       * obeying the "const" contract. */
-      int old_quiet = xdo->quiet;
-      xdo_t *xdo2 = (xdo_t *)xdo;
-      xdo2->quiet = 1;
-      int ret = xdo_get_desktop_for_window(xdo2, wid, &desktop);
-      xdo2->quiet = old_quiet;
-
-      /* Desktop matched if we support desktop queries *and* the desktop is
+/* Order the criteria of a plan by what they are expected to cost, so that
+ * a window is rejected (or, for SEARCH_ANY, accepted) as cheaply as
+ * possible.
+ *
+ * The cost is two for every request the property takes to fetch, plus the
+ * cost of the comparison: nothing for a number, one for a plain text
+ * pattern and two for a regex. Ties keep the PREDICATE_* order,
+ * which lists the most selective criteria first. */
+static void plan_predicates(xdo_search_plan_t *plan) {
+  const xdo_search_t *search = &plan->search;
+  int i, j;
+
+  plan->npredicates = 0;
+
+#define ADD_PREDICATE(want, pred, fetchbit, fetch_cost, pattern, is_required) \
+  do { \
+    if (want) { \
+      predicate_t *p = &plan->predicates[plan->npredicates++]; \
+      const xdo_pattern_t *re = pattern; \
+      p->id = pred; \
+      p->fetch = fetchbit; \
+      p->cost = fetch_cost; \
+      if (re != NULL) \
+        p->cost += (re->kind == PATTERN_REGEX) ? 2 : 1; \
+      p->required = is_required; \
+    } \
+  } while (0)
+
+  /* The name is _NET_WM_NAME, then WM_NAME if that isn't set, so it counts
+   * as two requests. The role is one, plus converting its text list. */
+  ADD_PREDICATE(search->searchmask & SEARCH_ONLYVISIBLE, PREDICATE_VISIBLE,
+                FETCH_ATTRIBUTES, 2, NULL, True);
+  ADD_PREDICATE(search->searchmask & SEARCH_DESKTOP, PREDICATE_DESKTOP,
+                FETCH_DESKTOP, 2, NULL, True);
+  ADD_PREDICATE(search->searchmask & SEARCH_PID, PREDICATE_PID,
+                FETCH_PID, 2, NULL, False);
+  ADD_PREDICATE(search->searchmask & SEARCH_CLASS, PREDICATE_CLASS,
+                FETCH_CLASS, 2, &plan->class_re, False);
+  ADD_PREDICATE(search->searchmask & SEARCH_CLASSNAME, PREDICATE_CLASSNAME,
+                FETCH_CLASS, 2, &plan->classname_re, False);
+  ADD_PREDICATE(search->searchmask & SEARCH_TITLE, PREDICATE_TITLE,
+                FETCH_NAME, 4, &plan->title_re, False);
+  ADD_PREDICATE(search->searchmask & SEARCH_NAME, PREDICATE_NAME,
+                FETCH_NAME, 4, &plan->name_re, False);
+  ADD_PREDICATE(search->searchmask & SEARCH_ROLE, PREDICATE_ROLE,
+                FETCH_ROLE, 3, &plan->role_re, False);
+
+#undef ADD_PREDICATE
+
+  /* Insertion sort; there are only a handful and it keeps ties in order. */
+  for (i = 1; i < plan->npredicates; i++) {
+    predicate_t p = plan->predicates[i];
+
+    for (j = i; j > 0 && plan->predicates[j - 1].cost > p.cost; j--)
+      plan->predicates[j] = plan->predicates[j - 1];
+    plan->predicates[j] = p;
+  }
+} /* void plan_predicates */
+
+static int test_predicate(const xdo_search_plan_t *plan,
+                          const predicate_t *predicate,
+                          const xdo_window_props_t *props) {
+  const xdo_search_t *search = &plan->search;
+
+  switch (predicate->id) {
+    case PREDICATE_VISIBLE:
+      return _xdo_is_window_visible(props);
+    case PREDICATE_DESKTOP:
+      /* Desktop matched if the window has a desktop *and* the desktop is
        * equal */
-      desktop_ok = (ret == XDO_SUCCESS && desktop == search->desktop);
-    }
+      return props->desktop != -1 && props->desktop == search->desktop;
+    case PREDICATE_PID:
+      return _xdo_match_window_pid(props, search->pid);
+    case PREDICATE_CLASS:
+      return _xdo_match_window_class(props, &plan->class_re);
+    case PREDICATE_CLASSNAME:
+      return _xdo_match_window_classname(props, &plan->classname_re);
+    case PREDICATE_TITLE:
+      return _xdo_match_window_title(props, &plan->title_re);
+    case PREDICATE_NAME:
+      return _xdo_match_window_name(props, &plan->name_re);
+    case PREDICATE_ROLE:
+      return _xdo_match_window_role(props, &plan->role_re);
+  }
 
-    /* Visibility is a hard condition, fail always if we wanted
-     * only visible windows and this one isn't */
-    if (visible_want && !_xdo_is_window_visible(xdo, wid)) {
-      if (debug) fprintf(stderr, "skip %ld visible\n", wid);
-      visible_ok = False;
-      break;
-    }
+  return False;
+} /* int test_predicate */
 
-    if (pid_want && !_xdo_match_window_pid(xdo, wid, search->pid)) {
-      if (debug) fprintf(stderr, "skip %ld pid\n", wid);
-      pid_ok = False;
-    }
+/* Visibility and desktop must always match. With SEARCH_ALL every other
+ * criterion must match too, with SEARCH_ANY at least one of them.
+ *
+ * Criteria are tested a batch at a time. Those whose properties are
+ * already in the records (kept by the index, or fetched for an earlier
+ * criterion) go first, then the rest in order of cost. Each property is
+ * fetched in one round trip for the windows still undecided when its
+ * criterion comes up, so a window rejected by a cheap criterion never has
+ * the expensive ones fetched. */
+static void check_window_match(xdo_window_props_t **records,
+                               unsigned int nrecords, int *matched,
+                               const search_run_t *run) {
+  const xdo_search_plan_t *plan = run->plan;
+  const xdo_search_t *search = &plan->search;
+  int want_all = (search->require == SEARCH_ALL);
+  int tested[FETCH_CHUNK];
+  int any_ok[FETCH_CHUNK];
+  int pass, i;
+  unsigned int j;
+
+  run->stats->windows += nrecords;
+
+  if (search->require != SEARCH_ALL && search->require != SEARCH_ANY) {
+    fprintf(stderr,
+            "Unexpected code reached. search->require is not valid? (%d); "
+            "this may be a bug?\n",
+            search->require);
+    for (j = 0; j < nrecords; j++)
+      matched[j] = False;
+    return;
+  }
 
-    if (title_want && !_xdo_match_window_title(xdo, wid, &title_re)) {
-      if (debug) fprintf(stderr, "skip %ld title\n", wid);
-      title_ok = False;
-    }
+  /* -1 until a window is decided. */
+  for (j = 0; j < nrecords; j++) {
+    matched[j] = -1;
+    tested[j] = 0;
+    any_ok[j] = False;
+  }
 
-    if (name_want && !_xdo_match_window_name(xdo, wid, &name_re)) {
-      if (debug) fprintf(stderr, "skip %ld winname\n", wid);
-      name_ok = False;
-    }
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < plan->npredicates; i++) {
+      const predicate_t *predicate = &plan->predicates[i];
+      predicate_stats_t *counts = &run->predicate_stats[predicate->id];
+      xdo_window_props_t *fetch[FETCH_CHUNK];
+      unsigned int testing[FETCH_CHUNK];
+      unsigned int nfetch = 0, ntesting = 0, k;
+
+      for (j = 0; j < nrecords; j++) {
+        if (matched[j] != -1 || (tested[j] & (1 << i)))
+          continue;
+
+        /* Once one criterion matched for SEARCH_ANY, only the required
+         * ones are left to test. */
+        if (any_ok[j] && !predicate->required)
+          continue;
+
+        if ((records[j]->fetched & predicate->fetch) == 0) {
+          /* The first pass only tests what needs nothing from the
+           * server. */
+          if (pass == 0)
+            continue;
+          fetch[nfetch++] = records[j];
+        }
+        testing[ntesting++] = j;
+      }
 
-    if (class_want && !_xdo_match_window_class(xdo, wid, &class_re)) {
-      if (debug) fprintf(stderr, "skip %ld winclass\n", wid);
-      class_ok = False;
-    }
+      if (nfetch > 0) {
+        unsigned int round_trips = run->stats->round_trips;
+
+        fetch_records(run->xdo, predicate->fetch, fetch, nfetch, run->stats);
+        counts->round_trips += run->stats->round_trips - round_trips;
+      }
+
+      for (k = 0; k < ntesting; k++) {
+        int ok;
 
-    if (classname_want && !_xdo_match_window_classname(xdo, wid, &classname_re)) {
-      if (debug) fprintf(stderr, "skip %ld winclassname\n", wid);
-      classname_ok = False;
+        j = testing[k];
+        tested[j] |= 1 << i;
+
+        counts->checked++;
+        ok = test_predicate(plan, predicate, records[j]);
+        if (ok)
+          counts->passed++;
+
+        if (!ok && (want_all || predicate->required))
+          matched[j] = False;
+        else if (ok && !want_all && !predicate->required)
+          any_ok[j] = True;
+      }
     }
+  }
 
-    if (role_want && !_xdo_match_window_role(xdo, wid, &role_re)) {
-      if (debug) fprintf(stderr, "skip %ld winrole\n", wid);
-      role_ok = False;
+  for (j = 0; j < nrecords; j++) {
+    if (matched[j] == -1)
+      matched[j] = want_all || any_ok[j];
+  }
+} /* void check_window_match */
+
+void _xdo_init_window_results(xdo_window_results_t *results,
+                              unsigned int limit, xdo_window_found_t found,
+                              void *data) {
+  memset(results, 0, sizeof(*results));
+  results->limit = limit;
+  results->found = found;
+  results->data = data;
+
+  if (found == NULL) {
+    results->size = 100;
+    results->list = calloc(sizeof(Window), results->size);
+  }
+} /* void _xdo_init_window_results */
+
+int _xdo_add_window_result(const xdo_t *xdo, xdo_window_results_t *results,
+                           Window window) {
+  if (results->found != NULL) {
+    if (results->found(xdo, window, results->data) == XDO_SEARCH_STOP)
+      results->stopped = True;
+  } else {
+    if (results->size == results->nwindows) {
+      results->size *= 2;
+      results->list = realloc(results->list, results->size * sizeof(Window));
     }
-  } while (0);
+    results->list[results->nwindows] = window;
+  }
+
+  results->nwindows++;
+  if (results->limit > 0 && results->nwindows >= results->limit)
+    results->stopped = True;
+
+  return results->stopped;
+} /* int _xdo_add_window_result */
+
+void _xdo_end_window_level(xdo_window_results_t *results) {
+  if (!results->keep_levels)
+    return;
 
-  regfree(&title_re);
-  regfree(&class_re);
-  regfree(&classname_re);
-  regfree(&name_re);
-  regfree(&role_re);
+  results->level_ends = realloc(results->level_ends,
+      (results->nlevels + 1) * sizeof(unsigned int));
+  results->level_ends[results->nlevels++] = results->nwindows;
+} /* void _xdo_end_window_level */
+
+/* Send XQueryTree requests for a level of the tree. */
+static xcb_query_tree_cookie_t *query_level(const xdo_t *xdo,
+                                            const Window *level,
+                                            unsigned int nlevel) {
+  xcb_connection_t *xcb = search_connection(xdo);
+  xcb_query_tree_cookie_t *cookies = calloc(nlevel ? nlevel : 1,
+                                            sizeof(*cookies));
+  unsigned int i;
+
+  for (i = 0; i < nlevel; i++)
+    cookies[i] = xcb_query_tree(xcb, level[i]);
+  xcb_flush(xcb);
+
+  return cookies;
+} /* xcb_query_tree_cookie_t *query_level */
+
+/* Collect the children of a level of the tree, in order, from the replies
+ * to query_level. */
+static Window *read_level(const xdo_t *xdo, xcb_query_tree_cookie_t *cookies,
+                          unsigned int nlevel, unsigned int *nnext_ret) {
+  xcb_connection_t *xcb = search_connection(xdo);
+  Window *next = NULL;
+  unsigned int i, nnext = 0, next_size = 0;
+
+  for (i = 0; i < nlevel; i++) {
+    xcb_generic_error_t *error = NULL;
+    xcb_query_tree_reply_t *tree;
+    xcb_window_t *children;
+    int j, nchildren;
+
+    /* TODO(sissel): report an error? */
+    tree = xcb_query_tree_reply(xcb, cookies[i], &error);
+    free(error);
+    if (tree == NULL)
+      continue;
 
-  if (debug) {
-    fprintf(stderr, "win: %ld, pid:%d, title:%d, name:%d, class:%d, visible:%d\n",
-            wid, pid_ok, title_ok, name_ok, class_ok, visible_ok);
+    children = xcb_query_tree_children(tree);
+    nchildren = xcb_query_tree_children_length(tree);
+    if (nnext + nchildren > next_size) {
+      next_size = nnext + nchildren + next_size;
+      next = realloc(next, next_size * sizeof(Window));
+    }
+    for (j = 0; j < nchildren; j++)
+      next[nnext++] = children[j];
+    free(tree);
   }
 
-  switch (search->require) {
-    case SEARCH_ALL:
-      return visible_ok && pid_ok && title_ok && name_ok && class_ok \
-             && classname_ok && desktop_ok && role_ok;
-      break;
-    case SEARCH_ANY:
-      return visible_ok && ((pid_want && pid_ok) || (title_want && title_ok) \
-                            || (name_want && name_ok) \
-                            || (role_want && role_ok) \
-                            || (class_want && class_ok) \
-                            || (classname_want && classname_ok)) \
-                         && desktop_ok;
+  free(cookies);
+  *nnext_ret = nnext;
+  return next;
+} /* Window *read_level */
+
+int _xdo_check_windows(const xdo_t *xdo, const Window *windows,
+                       unsigned int nwindows, int fetchmask,
+                       xdo_window_match_t match, const void *data,
+                       xdo_window_results_t *results,
+                       xdo_search_stats_t *stats) {
+  xdo_window_props_t props[FETCH_CHUNK];
+  xdo_window_props_t *records[FETCH_CHUNK];
+  int matched[FETCH_CHUNK];
+  unsigned int start;
+
+  for (start = 0; start < nwindows; start += FETCH_CHUNK) {
+    unsigned int i, n = nwindows - start;
+
+    if (n > FETCH_CHUNK)
+      n = FETCH_CHUNK;
+
+    if (results->stopped)
       break;
-  }
 
-  fprintf(stderr,
-          "Unexpected code reached. search->require is not valid? (%d); "
-          "this may be a bug?\n",
-          search->require);
-  return False;
-} /* int check_window_match */
-
-static void find_matching_windows(const xdo_t *xdo, Window window,
-                                  const xdo_search_t *search,
-                                  Window **windowlist_ret,
-                                  unsigned int *nwindows_ret,
-                                  unsigned int *windowlist_size,
-                                  int current_depth) {
-  /* Query for children of 'wid'. For each child, check match.
-   * We want to do a breadth-first search.
-   *
-   * If match, add to list.
-   * If over limit, break.
-   * Recurse.
-   */
-
-  Window dummy;
-  Window *children;
-  unsigned int i, nchildren;
-
-  /* Break early, if we have enough windows already. */
-  if (search->limit > 0 && *nwindows_ret >= search->limit) {
-    return;
+    _xdo_init_window_props(props, windows + start, n);
+    for (i = 0; i < n; i++) {
+      /* Windows the index knows about need nothing from the server. */
+      records[i] = _xdo_window_index_lookup(xdo, windows[start + i]);
+      if (records[i] == NULL)
+        records[i] = &props[i];
+      else
+        props[i].fetched = FETCH_ALL;
+    }
+    _xdo_fetch_window_props(xdo, fetchmask, props, n, stats);
+    match(records, n, matched, data);
+
+    for (i = 0; i < n; i++) {
+      if (!matched[i])
+        continue;
+
+      if (_xdo_add_window_result(xdo, results, windows[start + i])) {
+        /* Limit hit, or the caller has what it wants; break early. */
+        break;
+      }
+    }
+
+    _xdo_free_window_props(props, n);
   }
 
-  /* Break if too deep */
-  if (search->max_depth != -1 && current_depth > search->max_depth) {
-    return;
+  return results->stopped;
+} /* int _xdo_check_windows */
+
+int _xdo_get_client_list(const xdo_t *xdo, const Window *roots,
+                         unsigned int nroots, int stacking,
+                         int check_supported,
+                         Window **clients_ret, unsigned int *nclients_ret,
+                         xdo_search_stats_t *stats) {
+  xcb_connection_t *xcb = search_connection(xdo);
+  xcb_get_property_cookie_t *supported_cookies, *list_cookies;
+  Window *clients = NULL;
+  unsigned int i, nclients = 0;
+  Atom list_atom;
+  int supported = True;
+
+  intern_atoms(xdo);
+  list_atom = stacking ? atom_NET_CLIENT_LIST_STACKING : atom_NET_CLIENT_LIST;
+
+  supported_cookies = calloc(nroots ? nroots : 1, sizeof(*supported_cookies));
+  list_cookies = calloc(nroots ? nroots : 1, sizeof(*list_cookies));
+
+  /* Ask whether it's supported and for the list itself together, so this
+   * is one round trip either way. */
+  for (i = 0; i < nroots; i++) {
+    if (check_supported)
+      supported_cookies[i] = get_property(xcb, roots[i], atom_NET_SUPPORTED);
+    list_cookies[i] = get_property(xcb, roots[i], list_atom);
   }
+  xcb_flush(xcb);
+
+  if (stats != NULL)
+    stats->round_trips++;
+
+  for (i = 0; i < nroots; i++) {
+    xcb_get_property_reply_t *reply;
+    int found = !check_supported;
+
+    reply = NULL;
+    if (check_supported)
+      reply = get_property_reply(xcb, supported_cookies[i]);
+    if (reply != NULL && reply->format == 32) {
+      uint32_t *atoms = xcb_get_property_value(reply);
+      unsigned int j;
+
+      for (j = 0; j < reply->value_len; j++) {
+        if (atoms[j] == list_atom) {
+          found = True;
+          break;
+        }
+      }
+    }
+    free(reply);
 
-  /* Break if XQueryTree fails.
-   * TODO(sissel): report an error? */
-  Status success = XQueryTree(xdo->xdpy, window, &dummy, &dummy, &children, &nchildren);
+    if (!found)
+      supported = False;
 
-  if (!success) {
-    if (children != NULL)
-      free(children);
-    return;
+    reply = get_property_reply(xcb, list_cookies[i]);
+    if (supported && reply != NULL && reply->format == 32) {
+      uint32_t *windows = xcb_get_property_value(reply);
+      unsigned int j;
+
+      clients = realloc(clients,
+                        (nclients + reply->value_len + 1) * sizeof(Window));
+      for (j = 0; j < reply->value_len; j++)
+        clients[nclients++] = windows[j];
+    }
+    free(reply);
   }
 
-  /* Breadth first, check all children for matches */
-  for (i = 0; i < nchildren; i++) {
-    Window child = children[i];
-    if (!check_window_match(xdo, child, search))
-      continue;
+  free(supported_cookies);
+  free(list_cookies);
 
-    (*windowlist_ret)[*nwindows_ret] = child;
-    (*nwindows_ret)++;
+  if (!supported) {
+    free(clients);
+    clients = NULL;
+    nclients = 0;
+  }
 
-    if (search->limit > 0 && *nwindows_ret >= search->limit) {
-      /* Limit hit, break early. */
-      break;
+  *clients_ret = clients;
+  *nclients_ret = nclients;
+  return supported;
+} /* int _xdo_get_client_list */
+
+void _xdo_find_windows(const xdo_t *xdo, const Window *roots,
+                       unsigned int nroots, long max_depth, int fetchmask,
+                       xdo_window_match_t match, const void *data,
+                       xdo_window_results_t *results,
+                       xdo_search_stats_t *stats) {
+  Window *level = calloc(nroots ? nroots : 1, sizeof(Window));
+  unsigned int nlevel = nroots;
+  long depth = 0;
+
+  memcpy(level, roots, nroots * sizeof(Window));
+
+  while (nlevel > 0) {
+    xcb_query_tree_cookie_t *cookies = NULL;
+    int descend = (max_depth == -1 || depth + 1 <= max_depth);
+
+    /* Without a limit every child is going to be needed, so ask for them
+     * now and have the replies arrive while this level is checked. */
+    if (descend && results->limit == 0) {
+      cookies = query_level(xdo, level, nlevel);
+      stats->round_trips++;
     }
 
-    if (*windowlist_size == *nwindows_ret) {
-      *windowlist_size *= 2;
-      *windowlist_ret = realloc(*windowlist_ret,
-                                *windowlist_size * sizeof(Window));
+    if (_xdo_check_windows(xdo, level, nlevel, fetchmask, match, data,
+                           results, stats)) {
+      /* Stopping. Only a callback can stop a search without a limit, so
+       * only then are there children asked for that won't be used. */
+      if (cookies != NULL) {
+        xcb_connection_t *xcb = search_connection(xdo);
+        unsigned int i;
+
+        for (i = 0; i < nlevel; i++)
+          xcb_discard_reply(xcb, cookies[i].sequence);
+        free(cookies);
+      }
+      break;
     }
-  } /* for (i in children) ... */
 
-  /* Now check children-children */
-  if (search->max_depth == -1 || (current_depth + 1) <= search->max_depth) {
-    for (i = 0; i < nchildren; i++) {
-      find_matching_windows(xdo, children[i], search, windowlist_ret,
-                            nwindows_ret, windowlist_size,
-                            current_depth + 1);
+    if (!descend)
+      break;
+
+    _xdo_end_window_level(results);
+    if (cookies == NULL) {
+      cookies = query_level(xdo, level, nlevel);
+      stats->round_trips++;
     }
-  } /* recurse on children if not at max depth */
 
-  if (children != NULL)
-    free(children);
-} /* void find_matching_windows */
+    free(level);
+    level = read_level(xdo, cookies, nlevel, &nlevel);
+    depth++;
+  }
+
+  free(level);
+} /* void _xdo_find_windows */
@@ -0,0 +1,198 @@
+#ifndef _XDO_SEARCH_H
+#define _XDO_SEARCH_H
+
+#include <stddef.h>
+#include <regex.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include "xdo.h"
+
+/* Which window properties to fetch, see _xdo_fetch_window_props. */
+#define FETCH_ATTRIBUTES (1 << 0)
+#define FETCH_DESKTOP (1 << 1)
+#define FETCH_PID (1 << 2)
+#define FETCH_NAME (1 << 3)
+#define FETCH_CLASS (1 << 4)
+#define FETCH_ROLE (1 << 5)
+#define FETCH_PROPERTIES (1 << 6)
+
+#define FETCH_ALL (FETCH_ATTRIBUTES | FETCH_DESKTOP | FETCH_PID | FETCH_NAME \
+                   | FETCH_CLASS | FETCH_ROLE | FETCH_PROPERTIES)
+
+/* Everything a search or selection may test about a window.
+ *
+ * A record starts out empty (see _xdo_init_window_props) and each property
+ * is fetched at most once, the first time something asks for it. Records
+ * are fetched for a batch of sibling windows at once, so that a level of
+ * the tree costs one round trip per criterion rather than one round trip
+ * per window per criterion. The window index keeps one of these for every
+ * window it knows about. */
+typedef struct xdo_window_props {
+  Window window;
+  int fetched;      /* FETCH_* bits that have been filled in */
+
+  int map_state;
+  long desktop;     /* -1 if the window has no _NET_WM_DESKTOP */
+  int pid;          /* 0 if the window has no _NET_WM_PID */
+  char *name;       /* _NET_WM_NAME, or WM_NAME if that is unset */
+  char *res_name;   /* WM_CLASS instance name */
+  char *res_class;  /* WM_CLASS class name */
+
+  /* Set if WM_WINDOW_ROLE is set and not empty. */
+  int have_role;
+  char **role_list;
+  int role_count;
+
+  /* Every property set on the window (FETCH_PROPERTIES). */
+  Atom *properties;
+  int nproperties;
+} xdo_window_props_t;
+
+/* Counters for one search, printed when xdo->debug is set. */
+typedef struct xdo_search_stats {
+  unsigned int round_trips;
+  unsigned int windows;     /* windows checked against the query */
+} xdo_search_stats_t;
+
+void _xdo_init_window_props(xdo_window_props_t *props, const Window *windows,
+                            unsigned int nwindows);
+
+/* Fill in whichever of the fetchmask properties the records don't have yet.
+ * stats may be NULL. */
+void _xdo_fetch_window_props(const xdo_t *xdo, int fetchmask,
+                             xdo_window_props_t *props, unsigned int nwindows,
+                             xdo_search_stats_t *stats);
+void _xdo_free_window_props(xdo_window_props_t *props, unsigned int nwindows);
+
+/* Returns the FETCH_* bit that reads the given property, or 0 if the
+ * property is not one that searches look at. */
+int _xdo_property_fetchmask(const xdo_t *xdo, Atom atom);
+
+/* A compiled search pattern.
+ *
+ * Most patterns are plain text, maybe anchored with ^ and/or $. Those are
+ * matched with a case-insensitive string compare or substring scan, and only
+ * patterns using other regex operators go through regexec. Either way the
+ * result is the same as regexec with REG_EXTENDED | REG_ICASE. */
+typedef struct xdo_pattern {
+  int kind;         /* PATTERN_*, see xdo_search.c */
+  char *literal;    /* lowercased text to look for, unless kind is regex */
+  size_t len;
+  int has_re;       /* re is compiled, see _xdo_pattern_compile */
+  regex_t re;
+} xdo_pattern_t;
+
+/* Returns 0 on success, or the regcomp error code. */
+int _xdo_pattern_compile(xdo_pattern_t *pattern, const char *text);
+int _xdo_pattern_match(const xdo_pattern_t *pattern, const char *text);
+void _xdo_pattern_free(xdo_pattern_t *pattern);
+
+/* Where the windows a search finds go: appended to list, or, if found is
+ * set, handed to found one at a time as soon as each is found. */
+typedef struct xdo_window_results {
+  Window *list;             /* NULL if found is set */
+  unsigned int nwindows;
+  unsigned int size;
+  unsigned int limit;       /* 0 for no limit */
+  xdo_window_found_t found;
+  void *data;
+  int stopped;              /* the limit was hit, or found asked to stop */
+
+  /* If keep_levels is set, level_ends has how many windows had been found
+   * at the end of each level of the tree, see _xdo_end_window_level. */
+  int keep_levels;
+  unsigned int *level_ends;
+  unsigned int nlevels;
+} xdo_window_results_t;
+
+/* Set up results to collect a list of windows, or to call found with data
+ * if found is not NULL. */
+void _xdo_init_window_results(xdo_window_results_t *results,
+                              unsigned int limit, xdo_window_found_t found,
+                              void *data);
+
+/* Returns True if the search should stop. */
+int _xdo_add_window_result(const xdo_t *xdo, xdo_window_results_t *results,
+                           Window window);
+
+/* Called by the walkers once they are done with a level of the tree, and
+ * are going on to the next. */
+void _xdo_end_window_level(xdo_window_results_t *results);
+
+/* How many windows the walkers check in one go. Small enough that a search
+ * with a limit doesn't fetch much it won't look at, big enough that a full
+ * walk costs few round trips. */
+#define FETCH_CHUNK 32
+
+/* Set matched[i] to True if records[i] should be part of the results and
+ * to False if not, for a batch of at most FETCH_CHUNK records. Whatever a
+ * record is missing is up to the function to fetch, for as many of the
+ * batch at once as it can. */
+typedef void (*xdo_window_match_t)(xdo_window_props_t **records,
+                                   unsigned int nrecords, int *matched,
+                                   const void *data);
+
+/* Walk the window tree breadth first, starting with (and including) the
+ * given root windows, and add every window that matches to the results.
+ *
+ * Each level of the tree is fetched in batches, and the walk stops as soon
+ * as the results say so without asking the server for anything further.
+ * max_depth of -1 means unlimited. The properties in fetchmask are fetched
+ * for each batch before match is called, 0 leaves it all to match. */
+void _xdo_find_windows(const xdo_t *xdo, const Window *roots,
+                       unsigned int nroots, long max_depth, int fetchmask,
+                       xdo_window_match_t match, const void *data,
+                       xdo_window_results_t *results,
+                       xdo_search_stats_t *stats);
+
+/* Check a list of windows against match, in order, and add those that
+ * match to the results. Windows in the index use its records, the rest are
+ * fetched in batches. Returns True if the search should stop. */
+int _xdo_check_windows(const xdo_t *xdo, const Window *windows,
+                       unsigned int nwindows, int fetchmask,
+                       xdo_window_match_t match, const void *data,
+                       xdo_window_results_t *results,
+                       xdo_search_stats_t *stats);
+
+/* Read _NET_CLIENT_LIST (or _NET_CLIENT_LIST_STACKING if stacking is set)
+ * from each root, in one round trip. If check_supported is set, returns
+ * False, with an empty list, if the window manager on any of the roots does
+ * not list that property in _NET_SUPPORTED; otherwise whatever the roots
+ * have is taken as it is. The list is to be freed by the caller. */
+int _xdo_get_client_list(const xdo_t *xdo, const Window *roots,
+                         unsigned int nroots, int stacking,
+                         int check_supported,
+                         Window **clients_ret, unsigned int *nclients_ret,
+                         xdo_search_stats_t *stats);
+
+/* Waiting on the X connection, see xdo.c */
+
+/* Set when to the time ms milliseconds from now, on CLOCK_MONOTONIC. */
+void _xdo_time_after(struct timespec *when, int ms);
+
+/* Block until there is something to read from the X connection, or until
+ * the given time (never, if it is NULL). Returns False if nothing arrived.
+ * Flush any requests first. */
+int _xdo_wait_readable(const xdo_t *xdo, const struct timespec *until);
+
+/* Window index, see xdo_index.c */
+
+/* The same as _xdo_find_windows, but answered from the index, without any
+ * requests to the server. Windows are visited in the same order. Returns
+ * XDO_ERROR if a root is not in the index. */
+int _xdo_window_index_find(const xdo_t *xdo, const Window *roots,
+                           unsigned int nroots, long max_depth,
+                           xdo_window_match_t match, const void *data,
+                           xdo_window_results_t *results);
+
+/* The same as xdo_window_index_wait, but only return once the change could
+ * make match accept a window: a window that match accepts, or one above
+ * it, was created, mapped, reparented or had a property change. */
+int _xdo_window_index_wait_match(const xdo_t *xdo, int timeout,
+                                 xdo_window_match_t match, const void *data);
+
+/* The properties of a window in the index, or NULL if it isn't indexed. */
+xdo_window_props_t *_xdo_window_index_lookup(const xdo_t *xdo,
+                                             Window window);
+
+#endif
@@ -13,192 +13,178 @@
 #include <X11/extensions/XTest.h>
 #include "xdo.h"
 #include "xdo_select.h"
-
-static int compile_re(const char *pattern, regex_t *re);
-static int check_window_match(xdo_t *xdo, Window wid, xdo_select_t *selection);
-static int _select_by_class(const xdo_t *xdo, const xdo_select_t *selection,
-                                   Window window);
-static int _select_by_classname(const xdo_t *xdo, const xdo_select_t *selection,
-                                       Window window);
-static int _select_by_title(const xdo_t *xdo, const xdo_select_t *selection,
-                                   Window window);
-static int _select_by_role(const xdo_t *xdo, const xdo_select_t *selection,
-                                  Window window);
-static int _select_by_pid(const xdo_t *xdo, const xdo_select_t *selection,
-                                 Window window);
-static int _select_by_prop_exists(const xdo_t *xdo,
-                                  const xdo_select_t *selection,
-                                  Window window);
-static int _select_by_visible(const xdo_t *xdo, Window wid);
-static void find_matching_windows(xdo_t *xdo, Window window,
-                                  xdo_select_t *selection,
-                                  Window **windowlist_ret,
-                                  unsigned int *nwindows_ret,
-                                  unsigned int *windowlist_size,
-                                  int current_depth);
-
-static int _select_by_title(const xdo_t *xdo, const xdo_select_t *selection,
-                                   Window window) {
-  unsigned char *name;
-  int name_len;
-  int name_type;
-
-  xdo_get_window_name(xdo, window, &name, &name_len, &name_type);
-
+#include "xdo_search.h"
+
+/* One run of a selection over the index, see select_match. */
+typedef struct select_run {
+  const xdo_select_t *selection;
+  xdo_search_stats_t *stats;
+} select_run_t;
+
+static int compile_re(const char *pattern, xdo_pattern_t *re);
+static int check_window_match(xdo_window_props_t *props,
+                              const xdo_select_t *selection,
+                              xdo_search_stats_t *stats);
+static void select_match(xdo_window_props_t **records, unsigned int nrecords,
+                         int *matched, const void *data);
+static int select_fetchmask(const xdo_select_t *selection);
+static int _select_by_class(const xdo_select_t *selection,
+                            const xdo_window_props_t *props);
+static int _select_by_classname(const xdo_select_t *selection,
+                                const xdo_window_props_t *props);
+static int _select_by_title(const xdo_select_t *selection,
+                            const xdo_window_props_t *props);
+static int _select_by_role(const xdo_select_t *selection,
+                           const xdo_window_props_t *props);
+static int _select_by_pid(const xdo_select_t *selection,
+                          const xdo_window_props_t *props);
+static int _select_by_has_prop(const xdo_select_t *selection,
+                               const xdo_window_props_t *props);
+static int _xdo_is_window_visible(const xdo_window_props_t *props);
+static void select_run(xdo_select_t *selection,
+                       xdo_window_results_t *results);
+
+static int _select_by_title(const xdo_select_t *selection,
+                            const xdo_window_props_t *props) {
   char *title = "";
   int result;
 
-  if (name_len)
-    title = (char *)name;
+  if (props->name != NULL)
+    title = props->name;
 
   if (selection->rxmask & SEARCH_TITLE)
-    result = regexec(&selection->wintitlerx, title, 0, NULL, 0);
+    result = !_xdo_pattern_match(&selection->wintitlerx, title);
   else
     result = strcmp(title, selection->wintitle);
 
-  free(name);
   return result == 0;
 }
 
-static int _select_by_class(const xdo_t *xdo, const xdo_select_t *selection,
-                                   Window window) {
-  XWindowAttributes attr;
-  XClassHint classhint;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
+static int _select_by_class(const xdo_select_t *selection,
+                            const xdo_window_props_t *props) {
   char *res_class = "";
-  char *res_name = NULL;
-  int have_hint = XGetClassHint(xdo->xdpy, window, &classhint);
-
-  if (have_hint) {
-    res_class = classhint.res_class;
-    res_name = classhint.res_name;
-  }
-
   int result;
 
+  if (props->res_class != NULL)
+    res_class = props->res_class;
+
   if (selection->rxmask & SEARCH_CLASS)
-    result = regexec(&selection->winclassrx, res_class, 0, NULL, 0);
+    result = !_xdo_pattern_match(&selection->winclassrx, res_class);
   else
     result = strcmp(res_class, selection->winclass);
 
-  if (have_hint) {
-    free(classhint.res_name);
-    free(classhint.res_class);
-  }
-
   return result == 0;
 }
 
-static int _select_by_classname(const xdo_t *xdo,
-                                       const xdo_select_t *selection,
-                                       Window window) {
-  XWindowAttributes attr;
-  XClassHint classhint;
-  XGetWindowAttributes(xdo->xdpy, window, &attr);
-  char *res_class = NULL;
+static int _select_by_classname(const xdo_select_t *selection,
+                                const xdo_window_props_t *props) {
   char *res_name = "";
-  int have_hint = XGetClassHint(xdo->xdpy, window, &classhint);
-
-  if (have_hint) {
-    res_class = classhint.res_class;
-    res_name = classhint.res_name;
-  }
-
   int result;
 
+  if (props->res_name != NULL)
+    res_name = props->res_name;
+
   if (selection->rxmask & SEARCH_CLASSNAME)
-    result = regexec(&selection->winclassnamerx, res_name, 0, NULL, 0);
+    result = !_xdo_pattern_match(&selection->winclassnamerx, res_name);
   else
     result = strcmp(res_name, selection->winclassname);
 
-  if (have_hint) {
-    free(classhint.res_name);
-    free(classhint.res_class);
-  }
-
   return result == 0;
 }
 
-static int _select_by_role(const xdo_t *xdo, const xdo_select_t *selection,
-                                  Window window) {
-  int status;
-  int count = 0;
-  char **list = NULL;
-  XTextProperty tp;
-  char *role;
-
-  status = XGetTextProperty(xdo->xdpy, window, &tp,
-                            XInternAtom(xdo->xdpy, "WM_WINDOW_ROLE", False));
-
-  if (status && tp.nitems) {
-    Xutf8TextPropertyToTextList(xdo->xdpy, &tp, &list, &count);
-    role = list[0];
-  }
-  else
-    role = "";
-
+static int _select_by_role(const xdo_select_t *selection,
+                           const xdo_window_props_t *props) {
+  char *role = "";
   int result;
 
+  if (props->have_role && props->role_count > 0)
+    role = props->role_list[0];
+
   if (selection->rxmask & SEARCH_ROLE)
-    result = regexec(&selection->winrolerx, role, 0, NULL, 0);
+    result = !_xdo_pattern_match(&selection->winrolerx, role);
   else
     result = strcmp(role, selection->winrole);
 
-  XFreeStringList(list);
-  free(tp.value);
-
   return result == 0;
 }
 
-static int _select_by_pid(const xdo_t *xdo, const xdo_select_t *selection,
-                                 Window window) {
-  int window_pid = xdo_get_pid_window(xdo, window);
-
-  if (selection->pid == window_pid) {
+static int _select_by_pid(const xdo_select_t *selection,
+                          const xdo_window_props_t *props) {
+  if (selection->pid == props->pid) {
     return True;
   } else {
     return False;
   }
 }
 
-static int _select_by_has_prop(const xdo_t *xdo, const xdo_select_t *selection,
-                               Window window) {
-  if (xdo_get_has_property(xdo, window, selection->hasprop)) {
-    return True;
-  } else {
-    return False;
+static int _select_by_has_prop(const xdo_select_t *selection,
+                               const xdo_window_props_t *props) {
+  int i;
+
+  for (i = 0; i < props->nproperties; i++) {
+    if (props->properties[i] == selection->hasprop)
+      return True;
   }
+
+  return False;
 }
 
-static int compile_re(const char *pattern, regex_t *re) {
+static int compile_re(const char *pattern, xdo_pattern_t *re) {
   int ret;
   if (pattern == NULL) {
-    regcomp(re, "^$", REG_EXTENDED | REG_ICASE);
+    _xdo_pattern_compile(re, "^$");
     return True;
   }
 
-  ret = regcomp(re, pattern, REG_EXTENDED | REG_ICASE);
+  ret = _xdo_pattern_compile(re, pattern);
   if (ret != 0)
     return False;
 
   return True;
 }
 
-static int _xdo_is_window_visible(const xdo_t *xdo, Window wid) {
-  XWindowAttributes wattr;
-  XGetWindowAttributes(xdo->xdpy, wid, &wattr);
-  if (wattr.map_state != IsViewable)
+static int _xdo_is_window_visible(const xdo_window_props_t *props) {
+  if (props->map_state != IsViewable)
     return False;
 
   return True;
 }
 
-static int check_window_match(xdo_t *xdo, Window wid,
-                              xdo_select_t *selection) {
+/* Which window properties the selection needs to look at. */
+static int select_fetchmask(const xdo_select_t *selection) {
+  int fetchmask = 0;
+
+  if (selection->searchmask & SEARCH_ONLYVISIBLE)
+    fetchmask |= FETCH_ATTRIBUTES;
+  if (selection->searchmask & SEARCH_DESKTOP)
+    fetchmask |= FETCH_DESKTOP;
+  if (selection->searchmask & SEARCH_PID)
+    fetchmask |= FETCH_PID;
+  if (selection->searchmask & SEARCH_TITLE)
+    fetchmask |= FETCH_NAME;
+  if (selection->searchmask & (SEARCH_CLASS | SEARCH_CLASSNAME))
+    fetchmask |= FETCH_CLASS;
+  if (selection->searchmask & SEARCH_ROLE)
+    fetchmask |= FETCH_ROLE;
+  if (selection->searchmask & SEARCH_HAS_PROPERTY)
+    fetchmask |= FETCH_PROPERTIES;
+
+  return fetchmask;
+}
+
+/* Each criterion makes sure the property it tests has been fetched before
+ * looking at it. The tree walk fetches everything up front for a whole list
+ * of siblings, so this only costs anything for windows checked on their
+ * own, and then only until the first criterion that fails. */
+#define NEED(fetch) \
+  _xdo_fetch_window_props(selection->xdo, fetch, props, 1, stats)
+
+static int check_window_match(xdo_window_props_t *props,
+                              const xdo_select_t *selection,
+                              xdo_search_stats_t *stats) {
   int class_want = selection->searchmask & SEARCH_CLASS;
   int classname_want = selection->searchmask & SEARCH_CLASSNAME;
   int desktop_want = selection->searchmask & SEARCH_DESKTOP;
-  int name_want = selection->searchmask & SEARCH_NAME;
   int pid_want = selection->searchmask & SEARCH_PID;
   int role_want = selection->searchmask & SEARCH_ROLE;
   int title_want = selection->searchmask & SEARCH_TITLE;
@@ -207,44 +193,59 @@ static int check_window_match(xdo_t *xdo, Window wid,
 
   int ok = False;
 
+  stats->windows++;
+
   do {
     if (desktop_want) {
-      long desktop = -1;
-
-      /* We're modifying xdo here, but since we restore it, we're still
-       * obeying the "const" contract. */
-      int old_quiet = xdo->quiet;
-      xdo_t *xdo2 = (xdo_t *)xdo;
-      xdo2->quiet = 1;
-      int ret = xdo_get_desktop_for_window(xdo2, wid, &desktop);
-      xdo2->quiet = old_quiet;
+      NEED(FETCH_DESKTOP);
 
-      /* Desktop matched if we support desktop queries *and* the desktop is
+      /* Desktop matched if the window has a desktop *and* the desktop is
        * equal */
-      if (ret != XDO_SUCCESS || desktop != selection->desktop)
+      if (props->desktop == -1 || props->desktop != selection->desktop)
         break;
     }
 
-    if (visible_want && !_xdo_is_window_visible(xdo, wid))
-      break;
+    if (visible_want) {
+      NEED(FETCH_ATTRIBUTES);
+      if (!_xdo_is_window_visible(props))
+        break;
+    }
 
-    if (class_want && !_select_by_class(xdo, selection, wid))
-      break;
+    if (class_want) {
+      NEED(FETCH_CLASS);
+      if (!_select_by_class(selection, props))
+        break;
+    }
 
-    if (title_want && !_select_by_title(xdo, selection, wid))
-      break;
+    if (title_want) {
+      NEED(FETCH_NAME);
+      if (!_select_by_title(selection, props))
+        break;
+    }
 
-    if (classname_want && !_select_by_classname(xdo, selection, wid))
-      break;
+    if (classname_want) {
+      NEED(FETCH_CLASS);
+      if (!_select_by_classname(selection, props))
+        break;
+    }
 
-    if (pid_want && !_select_by_pid(xdo, selection, wid))
-      break;
+    if (pid_want) {
+      NEED(FETCH_PID);
+      if (!_select_by_pid(selection, props))
+        break;
+    }
 
-    if (role_want && !_select_by_role(xdo, selection, wid))
-      break;
+    if (role_want) {
+      NEED(FETCH_ROLE);
+      if (!_select_by_role(selection, props))
+        break;
+    }
 
-    if (prop_want && !_select_by_has_prop(xdo, selection, wid))
-      break;
+    if (prop_want) {
+      NEED(FETCH_PROPERTIES);
+      if (!_select_by_has_prop(selection, props))
+        break;
+    }
 
     ok = True;
   } while (0);
@@ -252,76 +253,15 @@ static int check_window_match(xdo_t *xdo, Window wid,
   return ok;
 }
 
-static void find_matching_windows(xdo_t *xdo, Window window,
-                                  xdo_select_t *selection,
-                                  Window **windowlist_ret,
-                                  unsigned int *nwindows_ret,
-                                  unsigned int *windowlist_size,
-                                  int current_depth) {
-  /* Query for children of 'wid'. For each child, check match.
-   * We want to do a breadth-first search.
-   *
-   * If match, add to list.
-   * If over limit, break.
-   * Recurse.
-   */
-
-  Window dummy;
-  Window *children;
-  unsigned int i, nchildren;
-
-  /* Break early, if we have enough windows already. */
-  if (selection->limit > 0 && *nwindows_ret >= selection->limit) {
-    return;
-  }
-
-  /* Break if too deep */
-  if (selection->max_depth != 0 && current_depth > selection->max_depth) {
-    return;
-  }
-
-  /* Break if XQueryTree fails.
-   * TODO(sissel): report an error? */
-  Status success = XQueryTree(xdo->xdpy, window, &dummy, &dummy, &children, &nchildren);
-
-  if (!success) {
-    if (children != NULL)
-      free(children);
-    return;
-  }
+#undef NEED
 
-  /* Breadth first, check all children for matches */
-  for (i = 0; i < nchildren; i++) {
-    Window child = children[i];
-    if (!check_window_match(xdo, child, selection))
-      continue;
-
-    (*windowlist_ret)[*nwindows_ret] = child;
-    (*nwindows_ret)++;
-
-    if (selection->limit > 0 && *nwindows_ret >= selection->limit) {
-      /* Limit hit, break early. */
-      break;
-    }
-
-    if (*windowlist_size == *nwindows_ret) {
-      *windowlist_size *= 2;
-      *windowlist_ret = realloc(*windowlist_ret,
-                                *windowlist_size * sizeof(Window));
-    }
-  }
+static void select_match(xdo_window_props_t **records, unsigned int nrecords,
+                         int *matched, const void *data) {
+  const select_run_t *run = (const select_run_t *)data;
+  unsigned int i;
 
-  /* Now check children-children */
-  if (selection->max_depth == 0 || (current_depth + 1) <= selection->max_depth) {
-    for (i = 0; i < nchildren; i++) {
-      find_matching_windows(xdo, children[i], selection, windowlist_ret,
-                            nwindows_ret, windowlist_size,
-                            current_depth + 1);
-    }
-  }
-
-  if (children != NULL)
-    free(children);
+  for (i = 0; i < nrecords; i++)
+    matched[i] = check_window_match(records[i], run->selection, run->stats);
 }
 
 xdo_select_t *xdo_select_new(xdo_t *xdo)
@@ -336,7 +276,7 @@ xdo_select_t *xdo_select_new(xdo_t *xdo)
 #define FREE_CRITERIA(flag, textprop, rxprop) \
 { \
   if (selection->rxmask & flag) \
-    regfree(&selection->rxprop); \
+    _xdo_pattern_free(&selection->rxprop); \
   else if (selection->searchmask & flag) \
     free(selection->textprop); \
 }
@@ -468,74 +408,101 @@ void xdo_select_set_has_property(xdo_select_t *selection, const char *property)
 
 int xdo_select_windows(xdo_select_t *selection, Window **windowlist_ret,
                        unsigned int *nwindows_ret) {
+  xdo_window_results_t results;
+
   if (selection->failed)
     return XDO_ERROR;
 
-  xdo_t *xdo = selection->xdo;
-  unsigned int windowlist_size = 100;
-  *nwindows_ret = 0;
-  *windowlist_ret = calloc(sizeof(Window), windowlist_size);
-
-  if (selection->searchmask & SEARCH_SCREEN) {
-      Window root = RootWindow(xdo->xdpy, selection->screen);
-      if (check_window_match(xdo, root, selection)) {
-        (*windowlist_ret)[*nwindows_ret] = root;
-        (*nwindows_ret)++;
-        /* Don't have to check for size bounds here because
-         * we start with array size 100 */
-      }
-
-      /* Start with depth=1 since we already covered the root windows */
-      find_matching_windows(xdo, root, selection, windowlist_ret, nwindows_ret,
-                            &windowlist_size, 1);
-  }
-  else if ((selection->searchmask & SEARCH_CLIENT_LIST) == 0) {
-    int i;
-    const int screencount = ScreenCount(xdo->xdpy);
-    for (i = 0; i < screencount; i++) {
-      Window root = RootWindow(xdo->xdpy, i);
-      if (check_window_match(xdo, root, selection)) {
-        (*windowlist_ret)[*nwindows_ret] = root;
-        (*nwindows_ret)++;
-        /* Don't have to check for size bounds here because
-         * we start with array size 100 */
-      }
-
-      /* Start with depth=1 since we already covered the root windows */
-      find_matching_windows(xdo, root, selection, windowlist_ret,
-                            nwindows_ret, &windowlist_size, 1);
-    }
-  }
-  else {
-    /* Search using the client list. */
-    Atom request = XInternAtom(xdo->xdpy, "_NET_CLIENT_LIST", False);
-    Window root = XDefaultRootWindow(xdo->xdpy);
-    Atom type;
-    int i, size;
-    long nitems;
+  _xdo_init_window_results(&results, selection->limit, NULL, NULL);
+  select_run(selection, &results);
 
-    unsigned char *data = xdo_get_window_property_by_atom(xdo, root, request,
-        &nitems, &type, &size);
-    Window *windows = (Window *)data;
+  *windowlist_ret = results.list;
+  *nwindows_ret = results.nwindows;
+  return XDO_SUCCESS;
+}
 
-    for (i = 0;i < nitems;i++) {
-      Window w = windows[i];
+int xdo_select_foreach(xdo_select_t *selection, xdo_window_found_t found,
+                       void *data) {
+  xdo_window_results_t results;
 
-      if (check_window_match(xdo, w, selection)) {
-        (*windowlist_ret)[*nwindows_ret] = w;
-        (*nwindows_ret)++;
-      }
+  if (selection->failed)
+    return XDO_ERROR;
 
-      if (selection->limit > 0 && *nwindows_ret >= selection->limit) {
-        /* Limit hit, break early. */
-        break;
-      }
+  _xdo_init_window_results(&results, selection->limit, found, data);
+  select_run(selection, &results);
+  return XDO_SUCCESS;
+}
+
+int xdo_select_wait(xdo_select_t *selection, int timeout) {
+  xdo_search_stats_t stats = { 0, 0 };
+  select_run_t run = { selection, &stats };
+
+  if (selection->failed)
+    return XDO_ERROR;
 
-      /* Recursing seems unnecessary here since these are not root windows. */
+  return _xdo_window_index_wait_match(selection->xdo, timeout, select_match,
+                                      &run);
+}
+
+static void select_run(xdo_select_t *selection,
+                       xdo_window_results_t *results) {
+  xdo_t *xdo = selection->xdo;
+  xdo_search_stats_t stats = { 0, 0 };
+
+  /* Answer from memory if there is an index, after catching up with what
+   * has changed. */
+  if (xdo->window_index != NULL)
+    xdo_window_index_update(xdo);
+
+  if (selection->searchmask & SEARCH_SCREEN
+      || (selection->searchmask & SEARCH_CLIENT_LIST) == 0) {
+    /* Zero means unlimited here, but -1 does for the tree walk. */
+    long max_depth = selection->max_depth ? selection->max_depth : -1;
+    select_run_t run = { selection, &stats };
+    Window *roots;
+    unsigned int i, nroots;
+
+    if (selection->searchmask & SEARCH_SCREEN) {
+      nroots = 1;
+      roots = calloc(1, sizeof(Window));
+      roots[0] = RootWindow(xdo->xdpy, selection->screen);
+    } else {
+      nroots = ScreenCount(xdo->xdpy);
+      roots = calloc(nroots, sizeof(Window));
+      for (i = 0; i < nroots; i++)
+        roots[i] = RootWindow(xdo->xdpy, i);
     }
 
+    if (xdo->window_index != NULL) {
+      _xdo_window_index_find(xdo, roots, nroots, max_depth, select_match,
+                             &run, results);
+    } else {
+      _xdo_find_windows(xdo, roots, nroots, max_depth,
+                        select_fetchmask(selection), select_match, &run,
+                        results, &stats);
+    }
+
+    free(roots);
+  }
+  else {
+    /* Search using the client list. */
+    Window root = XDefaultRootWindow(xdo->xdpy);
+    select_run_t run = { selection, &stats };
+    Window *windows;
+    unsigned int nitems;
+
+    /* Recursing seems unnecessary here since these are not root windows.
+     * The caller asked for the client list, so take whatever is there even
+     * if the window manager doesn't say it supports it. */
+    _xdo_get_client_list(xdo, &root, 1, False, False, &windows, &nitems,
+                         &stats);
+    _xdo_check_windows(xdo, windows, nitems, select_fetchmask(selection),
+                       select_match, &run, results, &stats);
     free(windows);
   }
 
-  return XDO_SUCCESS;
+  if (xdo->debug) {
+    fprintf(stderr, "select: checked %u windows, %u round trips, %u matches\n",
+            stats.windows, stats.round_trips, results->nwindows);
+  }
 }
@@ -1,8 +1,8 @@
 #ifndef _XDO_SELECT_H
 #define _XDO_SELECT_H
 
-#include <regex.h>
 #include "xdo.h"
+#include "xdo_search.h"
 
 typedef struct xdo_select {
   xdo_t *xdo;
@@ -11,10 +11,10 @@ typedef struct xdo_select {
   char *winrole;
   char *wintitle;
 
-  regex_t winclassrx;     /* pattern to test against a window class */
-  regex_t winclassnamerx; /* pattern to test against a window classname */
-  regex_t winrolerx;      /* pattern to test against a window role */
-  regex_t wintitlerx;     /* pattern to test against a window title */
+  xdo_pattern_t winclassrx;     /* pattern to test against a window class */
+  xdo_pattern_t winclassnamerx; /* pattern to test against a window classname */
+  xdo_pattern_t winrolerx;      /* pattern to test against a window role */
+  xdo_pattern_t wintitlerx;     /* pattern to test against a window title */
 
   int pid;            /* window pid (From window atom _NET_WM_PID) */
   long max_depth;     /* depth of search. 1 means only toplevel windows */
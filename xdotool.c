@@ -24,6 +24,8 @@
 #include <errno.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <locale.h>
 
 #include "xdo.h"
 #include "xdotool.h"
@@ -38,6 +40,7 @@ void window_list(context_t *context, const char *window_arg,
 int window_get_arg(context_t *context, int min_arg, int window_arg_pos,
                    const char **window_arg);
 int window_is_valid(context_t *context, const char *window_arg);
+int parse_timeout(const char *cmd, const char *arg, int *timeout_ret);
 int is_command(char* cmd);
 void xdotool_debug(context_t *context, const char *format, ...);
 void xdotool_output(context_t *context, const char *format, ...);
@@ -129,6 +132,23 @@ int window_get_arg(context_t *context, int min_arg, int window_arg_pos,
   return True;
 } /* int window_get_arg(context_t *, int, int, char **, int *) */
 
+int parse_timeout(const char *cmd, const char *arg, int *timeout_ret) {
+  char *end;
+  long timeout;
+
+  errno = 0;
+  timeout = strtol(arg, &end, 0);
+  if (errno != 0 || end == arg || *end != '\0' || timeout < 0
+      || timeout > INT_MAX) {
+    fprintf(stderr, "%s: invalid --timeout '%s', expected a number of "
+            "milliseconds, 0 or more\n", cmd, arg);
+    return False;
+  }
+
+  *timeout_ret = (int)timeout;
+  return True;
+} /* int parse_timeout(const char *, const char *, int *) */
+
 void window_list(context_t *context, const char *window_arg,
                  Window **windowlist_ret, int *nwindows_ret) {
   /* If window_arg is NULL and we have windows in the list, use the list.
@@ -284,6 +304,9 @@ int is_command(char* cmd) {
 }
 
 int main(int argc, char **argv) {
+  /* Only for printing characters in messages; typed text is always
+   * UTF-8. */
+  setlocale(LC_CTYPE, "");
   return xdotool_main(argc, argv);
 }
 